@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Read-only view of a contiguous array owned by someone else
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    ArrayView(const std::vector<T>& values)
+        : data_(values.data())
+        , size_(values.size()) {
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    const T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    ArrayView subview(size_t offset, size_t count) const {
+        return { data_ + offset, count };
+    }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,248 @@
+#include "benchmark.h"
+#include "log_duration.h"
+#include "search_server.h"
+#include <cmath>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+const string STOP_WORDS = "and with"s;
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+// The index layout SearchServer used before posting lists: a tree of trees
+// keyed by word and document id. Queries have the server's semantics, so it
+// also checks the server's results.
+class MapLayoutIndex {
+public:
+    explicit MapLayoutIndex(string_view stop_words)
+        : stop_words_(MakeUniqueNonEmptyStrings(SplitIntoWords(stop_words))) {
+    }
+
+    void AddDocument(int document_id, string_view document, int rating) {
+        const vector<string_view> words = SplitIntoWordsNoStop(document);
+        const double inv_word_count = 1.0 / words.size();
+        for (string_view word : words) {
+            word_to_document_freqs_[word][document_id] += inv_word_count;
+        }
+        ratings_.emplace(document_id, rating);
+    }
+
+    vector<Document> FindTopDocuments(string_view raw_query) const {
+        set<string_view> plus_words;
+        set<string_view> minus_words;
+        for (string_view word : SplitIntoWordsNoStop(raw_query)) {
+            if (word[0] == '-') {
+                word.remove_prefix(1);
+                if (!stop_words_.count(word)) {
+                    minus_words.insert(word);
+                }
+            }
+            else {
+                plus_words.insert(word);
+            }
+        }
+        map<int, double> document_to_relevance;
+        for (string_view word : plus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it == word_to_document_freqs_.end()) {
+                continue;
+            }
+            const double inverse_document_freq = log(ratings_.size() * 1.0 / it->second.size());
+            for (const auto& [document_id, term_freq] : it->second) {
+                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+            }
+        }
+        for (string_view word : minus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end()) {
+                for (const auto& [document_id, term_freq] : it->second) {
+                    document_to_relevance.erase(document_id);
+                }
+            }
+        }
+        vector<Document> matched_documents;
+        for (const auto& [document_id, relevance] : document_to_relevance) {
+            matched_documents.push_back({ document_id, relevance, ratings_.at(document_id) });
+        }
+        sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
+            if (abs(lhs.relevance - rhs.relevance) < SearchServer::MIN) {
+                return lhs.rating == rhs.rating ? lhs.id < rhs.id : lhs.rating > rhs.rating;
+            }
+            return lhs.relevance > rhs.relevance;
+            });
+        if (matched_documents.size() > SearchServer::MAX_RESULT_DOCUMENT_COUNT) {
+            matched_documents.resize(SearchServer::MAX_RESULT_DOCUMENT_COUNT);
+        }
+        return matched_documents;
+    }
+
+private:
+    set<string, less<>> stop_words_;
+    map<string_view, map<int, double>> word_to_document_freqs_;
+    map<int, int> ratings_;
+
+    vector<string_view> SplitIntoWordsNoStop(string_view text) const {
+        vector<string_view> words;
+        for (string_view word : SplitIntoWords(text)) {
+            if (!stop_words_.count(word)) {
+                words.push_back(word);
+            }
+        }
+        return words;
+    }
+};
+
+template <typename Index>
+vector<vector<Document>> RunQueries(const string& mark, const Index& index, const vector<string>& queries) {
+    LOG_DURATION(mark);
+    vector<vector<Document>> results;
+    results.reserve(queries.size());
+    for (const string& query : queries) {
+        results.push_back(index.FindTopDocuments(query));
+    }
+    return results;
+}
+
+// Throws if the results differ by more than the rounding of the relevances
+void CheckSameResults(const vector<vector<Document>>& expected, const vector<vector<Document>>& actual, const vector<string>& queries) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const bool is_same = equal(expected[i].begin(), expected[i].end(), actual[i].begin(), actual[i].end(),
+            [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && lhs.rating == rhs.rating && abs(lhs.relevance - rhs.relevance) < SearchServer::MIN;
+            });
+        if (!is_same) {
+            throw logic_error("Результаты запроса «"s + queries[i] + "» не совпадают с эталоном"s);
+        }
+    }
+}
+
+SearchServer BuildSearchServer(const vector<string>& documents) {
+    LOG_DURATION("posting lists: build"s);
+    SearchServer search_server(STOP_WORDS);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+    }
+    return search_server;
+}
+
+SearchServer BulkLoadSearchServer(const vector<string>& documents) {
+    vector<NewDocument> batch;
+    batch.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 } });
+    }
+    LOG_DURATION("posting lists: bulk load"s);
+    SearchServer search_server(STOP_WORDS);
+    search_server.AddDocuments(batch);
+    return search_server;
+}
+
+void BenchmarkIndexLayout(const vector<string>& documents, const vector<string>& queries, const SearchServer& search_server) {
+    cerr << "Index layout, "s << documents.size() << " documents, "s << queries.size() << " queries"s << endl;
+    MapLayoutIndex map_index(STOP_WORDS);
+    {
+        LOG_DURATION("map layout: build"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            map_index.AddDocument(static_cast<int>(i), documents[i], 1);
+        }
+    }
+    const auto map_results = RunQueries("map layout: queries"s, map_index, queries);
+    const auto postings_results = RunQueries("posting lists: queries"s, search_server, queries);
+    CheckSameResults(map_results, postings_results, queries);
+    cerr << "results match"s << endl;
+}
+
+template <typename ExecutionPolicy>
+double RunQueries(const string& mark, const SearchServer& search_server, const vector<string>& queries, const ExecutionPolicy& policy) {
+    LOG_DURATION(mark);
+    double total_relevance = 0;
+    for (const string& query : queries) {
+        for (const Document& document : search_server.FindTopDocuments(policy, query)) {
+            total_relevance += document.relevance;
+        }
+    }
+    return total_relevance;
+}
+
+void BenchmarkParallelSearch(SearchServer& search_server, const vector<string>& queries) {
+    cerr << "Parallel search, "s << search_server.GetDocumentCount() << " documents, "s << queries.size() << " queries, "s
+        << thread::hardware_concurrency() << " cores"s << endl;
+    RunQueries("seq"s, search_server, queries, execution::seq);
+    // More workers than cores only preempt each other
+    const int core_count = max(static_cast<int>(thread::hardware_concurrency()), 1);
+    for (const int thread_count : { 1, 4, 16, 64 }) {
+        if (thread_count > core_count) {
+            cerr << "par, "s << thread_count << " workers: skipped, more than the cores"s << endl;
+            continue;
+        }
+        search_server.SetThreadPool(make_shared<ThreadPool>(thread_count));
+        RunQueries("par, "s + to_string(thread_count) + " workers"s, search_server, queries, execution::par);
+    }
+    search_server.SetThreadPool(ThreadPool::GetDefault());
+}
+
+}  // namespace
+
+void RunBenchmarks(int document_count) {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    vector<string> documents;
+    documents.reserve(document_count);
+    for (int i = 0; i < document_count; ++i) {
+        documents.push_back(GenerateQuery(generator, dictionary, 10));
+    }
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 3);
+    SearchServer search_server = BuildSearchServer(documents);
+    BulkLoadSearchServer(documents);
+    BenchmarkIndexLayout(documents, queries, search_server);
+    BenchmarkParallelSearch(search_server, queries);
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Synthetic load tests, run with `search-server bench [document_count]`
+void RunBenchmarks(int document_count);
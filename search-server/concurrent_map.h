@@ -46,7 +46,9 @@ public:
     }
 
     void Erase(const Key& key) {
-        buckets_[static_cast<uint64_t>(key) % buckets_.size()].map.erase(key);
+        auto& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+        std::lock_guard g(bucket.mutex);
+        bucket.map.erase(key);
     }
 
 private:
@@ -0,0 +1,51 @@
+#include "concurrent_search_server.h"
+#include <thread>
+using namespace std;
+
+namespace {
+
+size_t GetReaderSlot() {
+    static atomic<size_t> next_slot{ 0 };
+    thread_local const size_t slot = next_slot++;
+    return slot;
+}
+
+}  // namespace
+
+ConcurrentSearchServer::ConcurrentSearchServer(const SearchServer& search_server)
+    : instances_{ search_server, search_server } {
+}
+
+void ConcurrentSearchServer::Update(const function<void(SearchServer&)>& update) {
+    lock_guard guard(write_mutex_);
+    const int published = published_.load();
+    // Nobody reads the other instance; if the update throws, nothing is published
+    update(instances_[1 - published]);
+    published_.store(1 - published);
+
+    // Readers that could still see the old instance have registered in one of
+    // the epochs; wait for both so that the old instance is free
+    const int epoch = epoch_.load();
+    WaitForReaders(1 - epoch);
+    epoch_.store(1 - epoch);
+    WaitForReaders(epoch);
+    update(instances_[published]);
+}
+
+int ConcurrentSearchServer::BeginRead() const {
+    const int epoch = epoch_.load();
+    readers_[epoch][GetReaderSlot() % READER_SLOTS].value.fetch_add(1);
+    return epoch;
+}
+
+void ConcurrentSearchServer::EndRead(int epoch) const {
+    readers_[epoch][GetReaderSlot() % READER_SLOTS].value.fetch_sub(1);
+}
+
+void ConcurrentSearchServer::WaitForReaders(int epoch) const {
+    for (const ReaderCount& count : readers_[epoch]) {
+        while (count.value.load() != 0) {
+            this_thread::yield();
+        }
+    }
+}
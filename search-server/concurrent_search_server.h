@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "search_server.h"
+
+// Search server that can be queried while it is being modified. It keeps
+// two copies of the index: readers use the published one, writers update
+// the other, publish it, wait until the readers of the old copy have left
+// and then repeat the update on it. Readers never wait and never take a lock.
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(const SearchServer& search_server);
+
+    // Returns func(const SearchServer&). The server passed to func is not
+    // modified until func returns.
+    template <typename Func>
+    auto Read(Func func) const;
+
+    // Applies update(SearchServer&) to both copies; concurrent writers are
+    // serialized. The update is run twice, once on each copy, so it has to be
+    // deterministic, have no effects outside the server, and either succeed
+    // or throw leaving the server unchanged, as the methods of SearchServer
+    // do. Objects it creates are not shared: SetResultCacheCapacity or
+    // SetThreadPool with a new pool inside it gives each copy its own cache
+    // or pool, so set those up on the server passed to the constructor.
+    void Update(const std::function<void(SearchServer&)>& update);
+
+private:
+    static constexpr size_t READER_SLOTS = 16;
+
+    // Readers of one epoch, spread over cache lines to avoid contention
+    struct alignas(64) ReaderCount {
+        std::atomic<int64_t> value{ 0 };
+    };
+
+    struct ReadGuard {
+        const ConcurrentSearchServer& server;
+        int epoch;
+
+        ~ReadGuard() {
+            server.EndRead(epoch);
+        }
+    };
+
+    std::array<SearchServer, 2> instances_;
+    // Instance the readers use
+    std::atomic<int> published_{ 0 };
+    std::atomic<int> epoch_{ 0 };
+    mutable std::array<std::array<ReaderCount, READER_SLOTS>, 2> readers_;
+    std::mutex write_mutex_;
+
+    // Registers the reader in the current epoch and returns it
+    int BeginRead() const;
+
+    void EndRead(int epoch) const;
+
+    void WaitForReaders(int epoch) const;
+};
+
+template <typename Func>
+auto ConcurrentSearchServer::Read(Func func) const {
+    const ReadGuard guard{ *this, BeginRead() };
+    return func(static_cast<const SearchServer&>(instances_[published_.load()]));
+}
@@ -18,4 +18,7 @@ enum class DocumentStatus {
     IRRELEVANT,
     BANNED,
     REMOVED,
-};
\ No newline at end of file
+};
+
+// REMOVED has to stay the last status
+inline constexpr int DOCUMENT_STATUS_COUNT = static_cast<int>(DocumentStatus::REMOVED) + 1;
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "document_filter.h"
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define DOCUMENT_FILTER_SSE2
+#endif
+
+using namespace std;
+
+namespace {
+
+// Ratings per mask word
+constexpr size_t RATING_BLOCK_SIZE = 64;
+
+// Bit i is set if ratings[i] is in range
+uint64_t MatchRatingsScalar(const int* ratings, size_t count, int min_rating, int max_rating) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bits |= uint64_t{ ratings[i] >= min_rating && ratings[i] <= max_rating } << i;
+    }
+    return bits;
+}
+
+#ifdef DOCUMENT_FILTER_SSE2
+
+uint64_t MatchRatingsSse2(const int* ratings, int min_rating, int max_rating) {
+    const __m128i min = _mm_set1_epi32(min_rating);
+    const __m128i max = _mm_set1_epi32(max_rating);
+    uint64_t outside = 0;
+    for (size_t i = 0; i < RATING_BLOCK_SIZE; i += 4) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ratings + i));
+        const __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi32(chunk, min), _mm_cmpgt_epi32(chunk, max));
+        outside |= uint64_t{ static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(out_of_range))) } << i;
+    }
+    return ~outside;
+}
+
+__attribute__((target("avx2")))
+uint64_t MatchRatingsAvx2(const int* ratings, int min_rating, int max_rating) {
+    const __m256i min = _mm256_set1_epi32(min_rating);
+    const __m256i max = _mm256_set1_epi32(max_rating);
+    uint64_t outside = 0;
+    for (size_t i = 0; i < RATING_BLOCK_SIZE; i += 8) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ratings + i));
+        const __m256i out_of_range = _mm256_or_si256(_mm256_cmpgt_epi32(min, chunk), _mm256_cmpgt_epi32(chunk, max));
+        outside |= uint64_t{ static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(out_of_range))) } << i;
+    }
+    return ~outside;
+}
+
+#else
+
+uint64_t MatchRatingsBlockScalar(const int* ratings, int min_rating, int max_rating) {
+    return MatchRatingsScalar(ratings, RATING_BLOCK_SIZE, min_rating, max_rating);
+}
+
+#endif
+
+using MatchRatingsFunc = uint64_t(*)(const int*, int, int);
+
+MatchRatingsFunc ChooseMatchRatings() {
+#ifdef DOCUMENT_FILTER_SSE2
+    if (__builtin_cpu_supports("avx2")) {
+        return MatchRatingsAvx2;
+    }
+    return MatchRatingsSse2;
+#else
+    return MatchRatingsBlockScalar;
+#endif
+}
+
+}  // namespace
+
+DocumentFilter DocumentFilter::ByStatus(DocumentStatus status) {
+    DocumentFilter filter;
+    filter.statuses = 1u << static_cast<int>(status);
+    return filter;
+}
+
+bool DocumentFilter::HasRatingRange() const {
+    return min_rating != numeric_limits<int>::min() || max_rating != numeric_limits<int>::max();
+}
+
+bool DocumentFilter::Accepts(DocumentStatus status, int rating) const {
+    return (statuses >> static_cast<int>(status) & 1) != 0 && rating >= min_rating && rating <= max_rating;
+}
+
+void FilterRatings(const int* ratings, size_t count, int min_rating, int max_rating, uint64_t* mask) {
+    static const MatchRatingsFunc match_ratings = ChooseMatchRatings();
+    size_t i = 0;
+    for (; i + RATING_BLOCK_SIZE <= count; i += RATING_BLOCK_SIZE) {
+        mask[i / RATING_BLOCK_SIZE] &= match_ratings(ratings + i, min_rating, max_rating);
+    }
+    if (i < count) {
+        mask[i / RATING_BLOCK_SIZE] &= MatchRatingsScalar(ratings + i, count - i, min_rating, max_rating);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "document.h"
+
+// Filter of documents by status and rating. Unlike a predicate, it is
+// evaluated on whole columns of document attributes at once.
+struct DocumentFilter {
+    // Bit 1 << status for every accepted status
+    uint32_t statuses = ALL_STATUSES;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+
+    inline static constexpr uint32_t ALL_STATUSES = (1u << DOCUMENT_STATUS_COUNT) - 1;
+
+    static DocumentFilter ByStatus(DocumentStatus status);
+
+    bool HasRatingRange() const;
+
+    bool Accepts(DocumentStatus status, int rating) const;
+};
+
+// Clears the bits of the mask whose ratings are out of [min_rating, max_rating].
+// Bit i of mask[i / 64] stands for ratings[i].
+void FilterRatings(const int* ratings, size_t count, int min_rating, int max_rating, uint64_t* mask);
@@ -0,0 +1,60 @@
+#include "fingerprint.h"
+#include "stop_word_set.h"
+using namespace std;
+
+namespace {
+
+// Finalizer of SplitMix64, spreads every input bit over the whole result
+uint64_t Mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// Fixed across builds and standard libraries, unlike std::hash, since
+// fingerprints are stored in snapshots
+uint64_t HashWord(string_view word) {
+    return Mix(StopWordSet::Hash(word));
+}
+
+}  // namespace
+
+void DocumentFingerprint::AddWord(string_view word) {
+    // Sums of two independent hashes commute, so the word order does not matter
+    const uint64_t word_hash = HashWord(word);
+    low += word_hash;
+    high += Mix(word_hash ^ 0x9E3779B97F4A7C15ull);
+}
+
+bool operator==(const DocumentFingerprint& lhs, const DocumentFingerprint& rhs) {
+    return lhs.low == rhs.low && lhs.high == rhs.high;
+}
+
+bool operator!=(const DocumentFingerprint& lhs, const DocumentFingerprint& rhs) {
+    return !(lhs == rhs);
+}
+
+void SimHashBuilder::AddWord(string_view word, double weight) {
+    const uint64_t word_hash = HashWord(word);
+    for (int bit = 0; bit < 64; ++bit) {
+        bit_weights_[bit] += (word_hash >> bit & 1) ? weight : -weight;
+    }
+}
+
+uint64_t SimHashBuilder::Get() const {
+    uint64_t result = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (bit_weights_[bit] > 0) {
+            result |= uint64_t{ 1 } << bit;
+        }
+    }
+    return result;
+}
+
+int GetHammingDistance(uint64_t lhs, uint64_t rhs) {
+    int distance = 0;
+    for (uint64_t bits = lhs ^ rhs; bits != 0; bits &= bits - 1) {
+        ++distance;
+    }
+    return distance;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 128-bit hash of a set of words that does not depend on their order, so
+// documents with the same distinct words get equal fingerprints
+struct DocumentFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    // Every word must be added once
+    void AddWord(std::string_view word);
+};
+
+bool operator==(const DocumentFingerprint& lhs, const DocumentFingerprint& rhs);
+
+bool operator!=(const DocumentFingerprint& lhs, const DocumentFingerprint& rhs);
+
+struct DocumentFingerprintHasher {
+    size_t operator()(const DocumentFingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+// SimHash of weighted words: documents with similar words get fingerprints
+// that differ in few bits
+class SimHashBuilder {
+public:
+    void AddWord(std::string_view word, double weight);
+
+    uint64_t Get() const;
+
+private:
+    double bit_weights_[64] = {};
+};
+
+// Number of differing bits
+int GetHammingDistance(uint64_t lhs, uint64_t rhs);
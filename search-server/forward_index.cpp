@@ -0,0 +1,57 @@
+#include "forward_index.h"
+#include <algorithm>
+using namespace std;
+
+ForwardIndex::ForwardIndex(ArrayView<Entry> entries, ArrayView<uint64_t> offsets, shared_ptr<const void> storage)
+    : mapped_entries_(entries)
+    , mapped_offsets_(offsets)
+    , storage_(move(storage))
+{
+}
+
+void ForwardIndex::Append(const Entry* entries, size_t count) {
+    entries_.insert(entries_.end(), entries, entries + count);
+    offsets_.push_back(entries_.size());
+}
+
+ArrayView<ForwardIndex::Entry> ForwardIndex::Get(int ordinal) const {
+    const int mapped_ordinal_bound = GetMappedOrdinalBound();
+    if (ordinal < mapped_ordinal_bound) {
+        return mapped_entries_.subview(mapped_offsets_[ordinal], mapped_offsets_[ordinal + 1] - mapped_offsets_[ordinal]);
+    }
+    ordinal -= mapped_ordinal_bound;
+    return { entries_.data() + offsets_[ordinal], offsets_[ordinal + 1] - offsets_[ordinal] };
+}
+
+int ForwardIndex::GetOrdinalBound() const {
+    return GetMappedOrdinalBound() + static_cast<int>(offsets_.size()) - 1;
+}
+
+void ForwardIndex::Compact(const vector<int>& new_ordinals) {
+    ForwardIndex compacted;
+    for (int ordinal = 0; ordinal < GetOrdinalBound(); ++ordinal) {
+        if (new_ordinals[ordinal] != -1) {
+            const ArrayView<Entry> entries = Get(ordinal);
+            compacted.Append(entries.data(), entries.size());
+        }
+    }
+    *this = move(compacted);
+}
+
+bool ForwardIndex::Contains(ArrayView<Entry> entries, int term_id) {
+    const auto it = lower_bound(entries.begin(), entries.end(), term_id, [](const Entry& entry, int id) {
+        return entry.term_id < id;
+        });
+    return it != entries.end() && it->term_id == term_id;
+}
+
+uint32_t ForwardIndex::GetCount(ArrayView<Entry> entries, int term_id) {
+    const auto it = lower_bound(entries.begin(), entries.end(), term_id, [](const Entry& entry, int id) {
+        return entry.term_id < id;
+        });
+    return it != entries.end() && it->term_id == term_id ? it->count : 0;
+}
+
+int ForwardIndex::GetMappedOrdinalBound() const {
+    return mapped_offsets_.empty() ? 0 : static_cast<int>(mapped_offsets_.size()) - 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "array_view.h"
+
+// Terms of every document as (term id, occurrence count) entries sorted by
+// term id, stored back to back in ordinal order. Entries loaded from a
+// snapshot stay in its mapping; documents appended later go to owned arrays.
+class ForwardIndex {
+public:
+    struct Entry {
+        int32_t term_id;
+        uint32_t count;
+    };
+
+    ForwardIndex() = default;
+
+    // Borrows the entries of ordinals [0, offsets.size() - 1) from memory
+    // that storage keeps alive
+    ForwardIndex(ArrayView<Entry> entries, ArrayView<uint64_t> offsets, std::shared_ptr<const void> storage);
+
+    // Adds the next ordinal. The entries must be sorted by term id.
+    void Append(const Entry* entries, size_t count);
+
+    ArrayView<Entry> Get(int ordinal) const;
+
+    int GetOrdinalBound() const;
+
+    // Keeps the ordinals with new_ordinals[ordinal] != -1, renumbered in
+    // their original order, in owned arrays
+    void Compact(const std::vector<int>& new_ordinals);
+
+    static bool Contains(ArrayView<Entry> entries, int term_id);
+
+    // Occurrences of the term, zero if absent
+    static uint32_t GetCount(ArrayView<Entry> entries, int term_id);
+
+private:
+    ArrayView<Entry> mapped_entries_;
+    ArrayView<uint64_t> mapped_offsets_;
+    std::shared_ptr<const void> storage_;
+    // Entries of the ordinals after the mapped ones
+    std::vector<Entry> entries_;
+    std::vector<uint64_t> offsets_ = { 0 };
+
+    int GetMappedOrdinalBound() const;
+};
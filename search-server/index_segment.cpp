@@ -0,0 +1,172 @@
+#include "index_segment.h"
+#include "stream_vbyte.h"
+using namespace std;
+
+IndexSegment::IndexSegment(int ordinal_begin, int ordinal_end, ArrayView<uint64_t> term_blocks,
+    ArrayView<PostingBlock> blocks, ArrayView<uint8_t> data, shared_ptr<const void> storage)
+    : ordinal_begin_(ordinal_begin)
+    , ordinal_end_(ordinal_end)
+    , term_blocks_(term_blocks)
+    , blocks_(blocks)
+    , data_(data)
+    , storage_(move(storage)) {
+    for (const PostingBlock& block : blocks_) {
+        posting_count_ += block.posting_count;
+    }
+}
+
+int IndexSegment::GetOrdinalBegin() const {
+    return ordinal_begin_;
+}
+
+int IndexSegment::GetOrdinalEnd() const {
+    return ordinal_end_;
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+ArrayView<IndexSegment::PostingBlock> IndexSegment::GetBlocks(int term_id) const {
+    if (static_cast<size_t>(term_id) + 1 >= term_blocks_.size()) {
+        return {};
+    }
+    return blocks_.subview(term_blocks_[term_id], term_blocks_[term_id + 1] - term_blocks_[term_id]);
+}
+
+void IndexSegment::DecodeBlock(const PostingBlock& block, int* ordinals, uint32_t* counts) const {
+    // Ordinals are non-negative, so they are decoded in place as unsigned values
+    const uint8_t* data = data_.data() + block.data_offset;
+    data += DecodeStreamVByteDelta(data, block.posting_count, static_cast<uint32_t>(block.first_ordinal),
+        reinterpret_cast<uint32_t*>(ordinals));
+    DecodeStreamVByte(data, block.posting_count, counts);
+}
+
+bool IndexSegment::CheckLayout() const {
+    if (term_blocks_.empty() || term_blocks_[0] != 0 || term_blocks_[term_blocks_.size() - 1] != blocks_.size()
+        || !is_sorted(term_blocks_.begin(), term_blocks_.end()) || data_.size() < DATA_PADDING) {
+        return false;
+    }
+    const size_t data_end = data_.size() - DATA_PADDING;
+    uint32_t ordinals[BLOCK_SIZE];
+    for (size_t term = 0; term + 1 < term_blocks_.size(); ++term) {
+        int previous_ordinal = ordinal_begin_ - 1;
+        for (uint64_t i = term_blocks_[term]; i < term_blocks_[term + 1]; ++i) {
+            const PostingBlock& block = blocks_[i];
+            if (block.posting_count == 0 || block.posting_count > BLOCK_SIZE || block.data_offset > data_end
+                || block.first_ordinal <= previous_ordinal || block.last_ordinal < block.first_ordinal
+                || block.last_ordinal >= ordinal_end_) {
+                return false;
+            }
+            // Ordinal gaps and then counts, each preceded by its control bytes
+            size_t offset = block.data_offset;
+            for (int stream = 0; stream < 2; ++stream) {
+                if ((block.posting_count + 3) / 4 > data_end - offset) {
+                    return false;
+                }
+                const size_t size = GetStreamVByteSize(data_.data() + offset, block.posting_count);
+                if (size > data_end - offset) {
+                    return false;
+                }
+                offset += size;
+            }
+            // Ordinals must ascend from the first to the last one, with no
+            // gap wrapping around
+            DecodeStreamVByteDelta(data_.data() + block.data_offset, block.posting_count, 0, ordinals);
+            if (ordinals[0] != 0 || ordinals[block.posting_count - 1] != static_cast<uint32_t>(block.last_ordinal - block.first_ordinal)) {
+                return false;
+            }
+            for (uint32_t j = 1; j < block.posting_count; ++j) {
+                if (ordinals[j] <= ordinals[j - 1]) {
+                    return false;
+                }
+            }
+            previous_ordinal = block.last_ordinal;
+        }
+    }
+    return true;
+}
+
+ArrayView<uint64_t> IndexSegment::GetTermBlocks() const {
+    return term_blocks_;
+}
+
+ArrayView<IndexSegment::PostingBlock> IndexSegment::GetAllBlocks() const {
+    return blocks_;
+}
+
+ArrayView<uint8_t> IndexSegment::GetData() const {
+    return data_;
+}
+
+void IndexSegment::Encoder::Add(int ordinal, uint32_t count) {
+    ordinals_[size_] = static_cast<uint32_t>(ordinal);
+    counts_[size_] = count;
+    if (++size_ == BLOCK_SIZE) {
+        FlushBlock();
+    }
+}
+
+void IndexSegment::Encoder::EndTerm() {
+    if (size_ > 0) {
+        FlushBlock();
+    }
+    term_block_ends.push_back(blocks.size());
+}
+
+void IndexSegment::Encoder::FlushBlock() {
+    PostingBlock block{};
+    block.first_ordinal = static_cast<int32_t>(ordinals_[0]);
+    block.last_ordinal = static_cast<int32_t>(ordinals_[size_ - 1]);
+    block.posting_count = static_cast<uint32_t>(size_);
+    block.data_offset = data.size();
+    blocks.push_back(block);
+    // The first gap is taken from first_ordinal and is always zero
+    uint32_t previous = ordinals_[0];
+    for (size_t i = 0; i < size_; ++i) {
+        const uint32_t ordinal = ordinals_[i];
+        ordinals_[i] = ordinal - previous;
+        previous = ordinal;
+    }
+    EncodeStreamVByte(ordinals_, size_, data);
+    EncodeStreamVByte(counts_, size_, data);
+    size_ = 0;
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Assemble(int ordinal_begin, int ordinal_end, vector<Encoder>& encoders) {
+    struct Storage {
+        vector<uint64_t> term_blocks;
+        vector<PostingBlock> blocks;
+        vector<uint8_t> data;
+    };
+    auto storage = make_shared<Storage>();
+    size_t term_count = 0;
+    size_t block_count = 0;
+    size_t data_size = DATA_PADDING;
+    for (const Encoder& encoder : encoders) {
+        term_count += encoder.term_block_ends.size();
+        block_count += encoder.blocks.size();
+        data_size += encoder.data.size();
+    }
+    storage->term_blocks.reserve(term_count + 1);
+    storage->term_blocks.push_back(0);
+    storage->blocks.reserve(block_count);
+    storage->data.reserve(data_size);
+    for (Encoder& encoder : encoders) {
+        const uint64_t block_base = storage->blocks.size();
+        const uint64_t data_base = storage->data.size();
+        for (const uint64_t block_end : encoder.term_block_ends) {
+            storage->term_blocks.push_back(block_base + block_end);
+        }
+        for (PostingBlock block : encoder.blocks) {
+            block.data_offset += data_base;
+            storage->blocks.push_back(block);
+        }
+        storage->data.insert(storage->data.end(), encoder.data.begin(), encoder.data.end());
+        encoder = Encoder{};
+    }
+    storage->data.resize(storage->data.size() + DATA_PADDING, 0);
+    const Storage& arrays = *storage;
+    return make_shared<const IndexSegment>(ordinal_begin, ordinal_end, arrays.term_blocks,
+        arrays.blocks, arrays.data, move(storage));
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "array_view.h"
+#include "thread_pool.h"
+
+// Immutable postings of the documents with ordinals in [ordinal_begin,
+// ordinal_end). The postings of every term are split into blocks of up to
+// BLOCK_SIZE; a block stores the ordinal gaps and the occurrence counts,
+// each compressed with StreamVByte. The blocks of term t are
+// [term_blocks[t], term_blocks[t + 1]). The arrays live in the segment's own
+// storage or in a mapped snapshot kept alive by the segment.
+class IndexSegment {
+public:
+    inline static constexpr size_t BLOCK_SIZE = 128;
+
+    // Bytes after the encoded data that the vectorized decoder may read
+    inline static constexpr size_t DATA_PADDING = 16;
+
+    struct PostingBlock {
+        int32_t first_ordinal;
+        int32_t last_ordinal;
+        uint32_t posting_count;
+        uint32_t reserved;
+        uint64_t data_offset;
+    };
+
+    IndexSegment(int ordinal_begin, int ordinal_end, ArrayView<uint64_t> term_blocks,
+        ArrayView<PostingBlock> blocks, ArrayView<uint8_t> data, std::shared_ptr<const void> storage);
+
+    // Builds a segment from the postings that for_each_block(term_id, func)
+    // passes to func(ordinals, counts) for every term id below term_id_bound.
+    // Every ordinal is replaced with remap(ordinal); postings remapped to a
+    // negative value are dropped. The remapping has to keep the ordinals of
+    // a term ascending.
+    template <typename ForEachBlock, typename Remap>
+    static std::shared_ptr<const IndexSegment> Build(int ordinal_begin, int ordinal_end, int term_id_bound,
+        ForEachBlock for_each_block, Remap remap, ThreadPool& thread_pool);
+
+    int GetOrdinalBegin() const;
+
+    int GetOrdinalEnd() const;
+
+    size_t GetPostingCount() const;
+
+    ArrayView<PostingBlock> GetBlocks(int term_id) const;
+
+    // Decodes a block into arrays of BLOCK_SIZE elements
+    void DecodeBlock(const PostingBlock& block, int* ordinals, uint32_t* counts) const;
+
+    // Checks that the blocks and their encoded data lie within the arrays
+    // and that the ordinals of every term ascend within the segment's range,
+    // for segments read from a file
+    bool CheckLayout() const;
+
+    // Encoded arrays, as stored in a snapshot
+    ArrayView<uint64_t> GetTermBlocks() const;
+
+    ArrayView<PostingBlock> GetAllBlocks() const;
+
+    ArrayView<uint8_t> GetData() const;
+
+private:
+    inline static constexpr size_t TASKS_PER_THREAD = 4;
+
+    // Encodes the postings of consecutive terms
+    class Encoder {
+    public:
+        void Add(int ordinal, uint32_t count);
+
+        void EndTerm();
+
+        std::vector<PostingBlock> blocks;
+        std::vector<uint8_t> data;
+        // Number of blocks after every term
+        std::vector<uint64_t> term_block_ends;
+
+    private:
+        uint32_t ordinals_[BLOCK_SIZE];
+        uint32_t counts_[BLOCK_SIZE];
+        size_t size_ = 0;
+
+        void FlushBlock();
+    };
+
+    // Joins the output of encoders that covered consecutive term ranges
+    static std::shared_ptr<const IndexSegment> Assemble(int ordinal_begin, int ordinal_end, std::vector<Encoder>& encoders);
+
+    int ordinal_begin_;
+    int ordinal_end_;
+    size_t posting_count_ = 0;
+    ArrayView<uint64_t> term_blocks_;
+    ArrayView<PostingBlock> blocks_;
+    ArrayView<uint8_t> data_;
+    std::shared_ptr<const void> storage_;
+};
+
+template <typename ForEachBlock, typename Remap>
+std::shared_ptr<const IndexSegment> IndexSegment::Build(int ordinal_begin, int ordinal_end, int term_id_bound,
+    ForEachBlock for_each_block, Remap remap, ThreadPool& thread_pool) {
+    // Terms are independent: every task encodes its own range of term ids
+    const size_t task_count = std::min<size_t>(term_id_bound, (thread_pool.GetThreadCount() + 1) * TASKS_PER_THREAD);
+    std::vector<Encoder> encoders(task_count);
+    if (task_count > 0) {
+        thread_pool.ParallelFor(task_count, [&](size_t task) {
+            Encoder& encoder = encoders[task];
+            const int term_id_begin = static_cast<int>(static_cast<size_t>(term_id_bound) * task / task_count);
+            const int term_id_end = static_cast<int>(static_cast<size_t>(term_id_bound) * (task + 1) / task_count);
+            for (int term_id = term_id_begin; term_id < term_id_end; ++term_id) {
+                for_each_block(term_id, [&](ArrayView<int> ordinals, ArrayView<uint32_t> counts) {
+                    for (size_t i = 0; i < ordinals.size(); ++i) {
+                        if (const int ordinal = remap(ordinals[i]); ordinal >= 0) {
+                            encoder.Add(ordinal, counts[i]);
+                        }
+                    }
+                    });
+                encoder.EndTerm();
+            }
+            });
+    }
+    return Assemble(ordinal_begin, ordinal_end, encoders);
+}
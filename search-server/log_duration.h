@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <string>
 
 
 class LogDuration {
@@ -10,12 +11,9 @@ public:
     // с помощью using для удобства
     using Clock = std::chrono::steady_clock;
 
-    LogDuration(const std::string& name)
-        : name_(name) {
-    }
-
-    LogDuration(const std::string& name, std::ostream& output=std::cerr)
-        : name_(name) {
+    LogDuration(const std::string& name, std::ostream& output = std::cerr)
+        : name_(name)
+        , output_(output) {
     }
 
     ~LogDuration() {
@@ -24,12 +22,13 @@ public:
 
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        std::cerr << name_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        output_ << name_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
     }
 
 private:
     const Clock::time_point start_time_ = Clock::now();
     const std::string name_;
+    std::ostream& output_;
 };
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X ## Y
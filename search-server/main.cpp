@@ -1,5 +1,5 @@
 #include "search_server.h"
-#include "log_duration.h"
+#include "benchmark.h"
 #include <execution>
 #include <iostream>
 #include <random>
@@ -8,6 +8,7 @@
 
 #include "process_queries.h"
 #include "test_framework.h"
+#include "tests.h"
 
 using namespace std;
 void PrintDocument(const Document& document) {
@@ -16,7 +17,15 @@ void PrintDocument(const Document& document) {
         << "relevance = "s << document.relevance << ", "s
         << "rating = "s << document.rating << " }"s << endl;
 }
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "bench"s) {
+        RunBenchmarks(argc > 2 ? stoi(argv[2]) : 1'000'000);
+        return 0;
+    }
+    if (argc > 1 && argv[1] == "test"s) {
+        RunTests();
+        return 0;
+    }
     SearchServer search_server("and with"s);
     int id = 0;
     for (
@@ -0,0 +1,28 @@
+#include "posting_list.h"
+using namespace std;
+
+void PostingList::Append(int ordinal, uint32_t count) {
+    ordinals_.push_back(ordinal);
+    counts_.push_back(count);
+}
+
+ArrayView<int> PostingList::GetOrdinals() const {
+    return ordinals_;
+}
+
+ArrayView<uint32_t> PostingList::GetCounts() const {
+    return counts_;
+}
+
+size_t PostingList::size() const {
+    return ordinals_.size();
+}
+
+bool PostingList::empty() const {
+    return ordinals_.empty();
+}
+
+void PostingList::clear() {
+    vector<int>{}.swap(ordinals_);
+    vector<uint32_t>{}.swap(counts_);
+}
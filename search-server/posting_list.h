@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "array_view.h"
+
+// Postings of a single term: ordinals of the documents containing it in
+// ascending order and the number of occurrences in each of them in a
+// parallel array.
+class PostingList {
+public:
+    // Ordinals are assigned in increasing order, so adding a document is
+    // always an append
+    void Append(int ordinal, uint32_t count);
+
+    ArrayView<int> GetOrdinals() const;
+
+    ArrayView<uint32_t> GetCounts() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+    std::vector<int> ordinals_;
+    std::vector<uint32_t> counts_;
+};
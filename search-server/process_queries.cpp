@@ -5,23 +5,50 @@ vector<vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const vector<string>& queries) {
     vector<vector<Document>> result(queries.size());
-    transform(
-        execution::par,
-        queries.begin(), queries.end(),
-        result.begin(),
-        [&search_server](const string& query) {return search_server.FindTopDocuments(query); });
+    search_server.GetThreadPool()->ParallelFor(queries.size(),
+        [&search_server, &queries, &result](size_t i) {result[i] = search_server.FindTopDocuments(queries[i]); });
     return result;
 }
 
 vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    vector<vector<Document>> temp_docs = ProcessQueries(search_server, queries);
-    vector<Document> result;
-    for (const vector<Document>& documents : temp_docs) {
-        for (const Document& document : documents) {
-            result.push_back(document);
+    return ProcessQueriesFlat(search_server, queries).documents;
+}
+
+QueryBatchResults ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const vector<string>& queries) {
+    // Every query writes straight into its own slot of the buffer and stores
+    // its document count in offsets[i + 1]. The slots are then packed.
+    constexpr int max_count = SearchServer::MAX_RESULT_DOCUMENT_COUNT;
+    QueryBatchResults results;
+    results.documents.resize(queries.size() * max_count);
+    results.offsets.resize(queries.size() + 1);
+    search_server.GetThreadPool()->ParallelFor(queries.size(),
+        [&search_server, &queries, &results](size_t i) {
+            results.offsets[i + 1] = search_server.FindTopDocuments(
+                queries[i], DocumentStatus::ACTUAL, &results.documents[i * max_count], max_count);
+        });
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const size_t count = results.offsets[i + 1];
+        // std::move must not start at its own source
+        if (results.offsets[i] != i * max_count) {
+            const auto slot = results.documents.begin() + i * max_count;
+            move(slot, slot + count, results.documents.begin() + results.offsets[i]);
         }
+        results.offsets[i + 1] = results.offsets[i] + count;
     }
-    return result;
-}
\ No newline at end of file
+    results.documents.resize(results.offsets.back());
+    return results;
+}
+
+void ProcessQueries(
+    const SearchServer& search_server,
+    const vector<SearchServer::PreparedQuery>& queries,
+    const QueryResultHandler& on_result,
+    ThreadPool::Quota* quota) {
+    search_server.GetThreadPool()->ParallelFor(queries.size(),
+        [&search_server, &queries, &on_result](size_t i) {on_result(i, search_server.FindTopDocuments(queries[i])); },
+        quota);
+}
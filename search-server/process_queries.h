@@ -1,5 +1,6 @@
 #pragma once
 #include <execution>
+#include <functional>
 #include <string>
 #include <vector>
 #include "search_server.h"
@@ -10,4 +11,28 @@ std::vector<std::vector<Document>> ProcessQueries(
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Documents of a whole batch in one buffer: the documents of query i are
+// documents[offsets[i]] .. documents[offsets[i + 1] - 1]
+struct QueryBatchResults {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets;
+};
+
+QueryBatchResults ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Receives the index of a query and its documents. May be called from
+// several pool threads at once.
+using QueryResultHandler = std::function<void(size_t query_index, std::vector<Document> documents)>;
+
+// Runs the queries on the server's thread pool and hands every result to
+// on_result as soon as it is ready. A quota caps the workers the batch may
+// occupy.
+void ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<SearchServer::PreparedQuery>& queries,
+    const QueryResultHandler& on_result,
+    ThreadPool::Quota* quota = nullptr);
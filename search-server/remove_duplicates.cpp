@@ -1,24 +1,61 @@
 #include "remove_duplicates.h"
+#include <unordered_map>
+#include <unordered_set>
 using namespace std;
 
+namespace {
+
+void RemoveDocuments(SearchServer& search_server, const vector<int>& ids_to_delete) {
+    for (auto id : ids_to_delete) {
+        search_server.RemoveDocument(id);
+        cout << "Found duplicate document id "s << id << endl;
+    }
+}
+
+}  // namespace
+
 void RemoveDuplicates(SearchServer& search_server) {
-    set<int> id_to_delete;
-    set<set<string_view>> server_words;
+    vector<int> ids_to_delete;
+    unordered_set<DocumentFingerprint, DocumentFingerprintHasher> fingerprints;
     for (const int document_id : search_server) {
-        map<string_view, double> words_id = search_server.GetWordFrequencies(document_id);
-        set<string_view> words;
-        for (const auto [word, freq] : words_id) {
-            words.insert(word);
+        if (!fingerprints.insert(search_server.GetDocumentFingerprint(document_id)).second) {
+            ids_to_delete.push_back(document_id);
         }
-        if (server_words.count(words)) {            
-                id_to_delete.insert(document_id);
-           
-        }
-        else { server_words.insert(words); }
     }
-    for (auto id : id_to_delete) {
-        search_server.RemoveDocument(id);
-        cout << "Found duplicate document id "s << id << endl;
-        
+    RemoveDocuments(search_server, ids_to_delete);
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, int max_distance) {
+    if (max_distance < 0 || max_distance > 7) {
+        throw invalid_argument("Допустимое расстояние между документами от 0 до 7 бит"s);
+    }
+    // Hashes within max_distance bits agree in at least one of max_distance + 1 bands
+    const int band_count = max_distance + 1;
+    const int band_width = 64 / band_count;
+    const uint64_t band_mask = band_width == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << band_width) - 1;
+    vector<unordered_map<uint64_t, vector<uint64_t>>> bands(band_count);
+    vector<int> ids_to_delete;
+    for (const int document_id : search_server) {
+        const uint64_t sim_hash = search_server.ComputeSimHash(document_id);
+        bool is_duplicate = false;
+        for (int band = 0; band < band_count && !is_duplicate; ++band) {
+            const auto bucket = bands[band].find(sim_hash >> (band * band_width) & band_mask);
+            if (bucket != bands[band].end()) {
+                for (const uint64_t kept_hash : bucket->second) {
+                    if (GetHammingDistance(sim_hash, kept_hash) <= max_distance) {
+                        is_duplicate = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (is_duplicate) {
+            ids_to_delete.push_back(document_id);
+            continue;
+        }
+        for (int band = 0; band < band_count; ++band) {
+            bands[band][sim_hash >> (band * band_width) & band_mask].push_back(sim_hash);
+        }
     }
-}
\ No newline at end of file
+    RemoveDocuments(search_server, ids_to_delete);
+}
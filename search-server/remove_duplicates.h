@@ -2,4 +2,9 @@
 #include "document.h"
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Removes the documents with the same distinct words as a document with a smaller id
+void RemoveDuplicates(SearchServer& search_server);
+
+// Removes the documents whose SimHash differs in at most max_distance bits
+// from that of a kept document with a smaller id. max_distance is at most 7.
+void RemoveNearDuplicates(SearchServer& search_server, int max_distance);
@@ -5,8 +5,8 @@ RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_(s
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status; });
+    // Queries by status can be answered from the server's result cache
+    return AddResults(search_server_.FindTopDocuments(raw_query, status));
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query) {
@@ -14,4 +14,19 @@ vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query) {
 }
 int RequestQueue::GetNoResultRequests() const {
     return no_result_requests_;
+}
+
+vector<Document> RequestQueue::AddResults(vector<Document> results) {
+    if (results.empty()) {
+        ++no_result_requests_;
+        if (no_result_requests_ > min_in_day_) {
+            --no_result_requests_;
+        }
+    }
+    requests_.push_back({ static_cast<int>(results.size()) });
+    if (requests_.size() > min_in_day_) {
+        requests_.pop_front();
+        --no_result_requests_;
+    }
+    return results;
 }
\ No newline at end of file
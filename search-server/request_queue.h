@@ -17,6 +17,9 @@ public:
 
     int GetNoResultRequests() const;
 private:
+    // Records the request and passes its results through
+    std::vector<Document> AddResults(std::vector<Document> results);
+
     struct QueryResult {
         int results_count_;
     };
@@ -28,19 +31,5 @@ private:
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string_view& raw_query, DocumentPredicate document_predicate) {
-    auto results = search_server_.FindTopDocuments(raw_query, document_predicate);
-
-    if (results.empty()) {
-        ++no_result_requests_;
-        if (no_result_requests_ > min_in_day_) {
-            --no_result_requests_;
-        }
-    }
-    requests_.push_back({ static_cast<int>(results.size()) });
-    if (requests_.size() > min_in_day_) {
-        requests_.pop_front();
-        --no_result_requests_;
-    }
-    return results;
-
+    return AddResults(search_server_.FindTopDocuments(raw_query, document_predicate));
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "result_cache.h"
+using namespace std;
+
+ResultCache::ResultCache(size_t capacity)
+    : shard_capacity_((capacity + SHARD_COUNT - 1) / SHARD_COUNT)
+{
+}
+
+bool ResultCache::Find(const string& key, vector<Document>& result) {
+    Shard& shard = GetShard(key);
+    {
+        lock_guard guard(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            result = it->second->second;
+            hits_.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+void ResultCache::Insert(string key, vector<Document> result) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // Another thread computed the same result meanwhile
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    if (shard.entries.size() >= shard_capacity_) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+    shard.entries.emplace_front(move(key), move(result));
+    shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+    return { hits_.load(memory_order_relaxed), misses_.load(memory_order_relaxed) };
+}
+
+ResultCache::Shard& ResultCache::GetShard(const string& key) {
+    return shards_[hash<string>{}(key) % SHARD_COUNT];
+}
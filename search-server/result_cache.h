@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "document.h"
+
+// Thread-safe LRU cache of query results. Keys are split between shards with
+// their own locks and recency lists, so concurrent queries rarely contend.
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // Holds at most about capacity results
+    explicit ResultCache(size_t capacity);
+
+    // Copies the cached result to result and marks it recently used
+    bool Find(const std::string& key, std::vector<Document>& result);
+
+    // Evicts the least recently used result of the key's shard when it is full
+    void Insert(std::string key, std::vector<Document> result);
+
+    Stats GetStats() const;
+
+private:
+    inline static constexpr size_t SHARD_COUNT = 16;
+
+    using Entry = std::pair<std::string, std::vector<Document>>;
+
+    struct Shard {
+        std::mutex mutex;
+        // The most recently used entry first
+        std::list<Entry> entries;
+        // Keys point into the entries, whose nodes never move
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    Shard& GetShard(const std::string& key);
+
+    const size_t shard_capacity_;
+    Shard shards_[SHARD_COUNT];
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+};
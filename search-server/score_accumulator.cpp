@@ -0,0 +1,37 @@
+#include "score_accumulator.h"
+using namespace std;
+
+void ScoreAccumulator::Reset(int ordinal_bound) {
+    Clear();
+    if (ordinal_bound > static_cast<int>(scores_.size())) {
+        scores_.resize(ordinal_bound, 0.0);
+        const size_t mask_size = (static_cast<size_t>(ordinal_bound) + 63) / 64;
+        touched_mask_.resize(mask_size, 0);
+        excluded_mask_.resize(mask_size, 0);
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    if (shards_dirty_) {
+        // A shard was interrupted, so its entries are known only to the masks
+        DrainShard(0, static_cast<int>(scores_.size()), [](int, double) {});
+        shards_dirty_ = false;
+    }
+    for (const int ordinal : touched_) {
+        scores_[ordinal] = 0.0;
+        Unset(touched_mask_, ordinal);
+    }
+    for (const int ordinal : excluded_) {
+        Unset(excluded_mask_, ordinal);
+    }
+    touched_.clear();
+    excluded_.clear();
+}
+
+void ScoreAccumulator::BeginShards() {
+    shards_dirty_ = true;
+}
+
+void ScoreAccumulator::EndShards() {
+    shards_dirty_ = false;
+}
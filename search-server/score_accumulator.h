@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Relevance scores indexed by document ordinal. Clear() resets only the
+// entries touched since the previous call, so one accumulator is reused
+// across queries without reallocating.
+class ScoreAccumulator {
+public:
+    // Makes ordinals below ordinal_bound addressable and drops previous scores
+    void Reset(int ordinal_bound);
+
+    void Clear();
+
+    void Add(int ordinal, double score) {
+        if (!IsSet(touched_mask_, ordinal)) {
+            Set(touched_mask_, ordinal);
+            touched_.push_back(ordinal);
+        }
+        scores_[ordinal] += score;
+    }
+
+    // Excluded documents are skipped by the caller when scoring
+    void Exclude(int ordinal) {
+        if (!IsSet(excluded_mask_, ordinal)) {
+            Set(excluded_mask_, ordinal);
+            excluded_.push_back(ordinal);
+        }
+    }
+
+    bool IsExcluded(int ordinal) const {
+        return IsSet(excluded_mask_, ordinal);
+    }
+
+    double GetScore(int ordinal) const {
+        return scores_[ordinal];
+    }
+
+    // Scored ordinals in the order they were first added
+    const std::vector<int>& GetTouched() const {
+        return touched_;
+    }
+
+    // Shards let several threads score one query at once. Each thread must
+    // stay inside its own range of ordinals aligned to SHARD_ALIGNMENT and
+    // drain that range when done.
+    inline static constexpr int SHARD_ALIGNMENT = 64;
+
+    // Must be called before handing the accumulator to shards
+    void BeginShards();
+
+    void AddInShard(int ordinal, double score) {
+        Set(touched_mask_, ordinal);
+        scores_[ordinal] += score;
+    }
+
+    void ExcludeInShard(int ordinal) {
+        Set(excluded_mask_, ordinal);
+    }
+
+    // Calls func(ordinal, score) for the scored ordinals of [begin, end) in
+    // ascending order and clears the range
+    template <typename Func>
+    void DrainShard(int begin, int end, Func func);
+
+    // Must be called once every shard is drained
+    void EndShards();
+
+private:
+    std::vector<double> scores_;
+    std::vector<uint64_t> touched_mask_;
+    std::vector<uint64_t> excluded_mask_;
+    std::vector<int> touched_;
+    std::vector<int> excluded_;
+    // Set while shards may have left entries outside the touched lists
+    bool shards_dirty_ = false;
+
+    static bool IsSet(const std::vector<uint64_t>& mask, int ordinal) {
+        return (mask[ordinal >> 6] >> (ordinal & 63)) & 1;
+    }
+
+    static void Set(std::vector<uint64_t>& mask, int ordinal) {
+        mask[ordinal >> 6] |= uint64_t{ 1 } << (ordinal & 63);
+    }
+
+    static void Unset(std::vector<uint64_t>& mask, int ordinal) {
+        mask[ordinal >> 6] &= ~(uint64_t{ 1 } << (ordinal & 63));
+    }
+};
+
+template <typename Func>
+void ScoreAccumulator::DrainShard(int begin, int end, Func func) {
+    for (int word = begin / 64; word < (end + 63) / 64; ++word) {
+        uint64_t bits = touched_mask_[word];
+        while (bits) {
+            const int ordinal = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            func(ordinal, scores_[ordinal]);
+            scores_[ordinal] = 0.0;
+        }
+        touched_mask_[word] = 0;
+        excluded_mask_[word] = 0;
+    }
+}
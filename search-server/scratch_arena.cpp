@@ -0,0 +1,68 @@
+#include "scratch_arena.h"
+#include <algorithm>
+using namespace std;
+
+ScratchArena::Scope::Scope(ScratchArena& arena)
+    : arena_(arena)
+    , chunk_(arena.chunk_)
+    , offset_(arena.offset_)
+{
+}
+
+ScratchArena::Scope::~Scope() {
+    arena_.chunk_ = chunk_;
+    arena_.offset_ = offset_;
+}
+
+ScratchArena::ScratchArena(size_t chunk_size)
+    : next_chunk_size_(chunk_size)
+{
+}
+
+ScratchArena::Stats ScratchArena::GetStats() const {
+    return stats_;
+}
+
+ScratchArena& ScratchArena::GetThreadArena() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+uint64_t ScratchArena::GetTotalUpstreamAllocations() {
+    return total_upstream_allocations_.load(memory_order_relaxed);
+}
+
+void* ScratchArena::do_allocate(size_t bytes, size_t alignment) {
+    while (true) {
+        if (chunk_ < chunks_.size()) {
+            const Chunk& chunk = chunks_[chunk_];
+            const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+            const size_t begin = ((base + offset_ + alignment - 1) & ~(uintptr_t{ alignment } - 1)) - base;
+            if (begin <= chunk.size && bytes <= chunk.size - begin) {
+                offset_ = begin + bytes;
+                return chunk.data.get() + begin;
+            }
+            if (chunk_ + 1 < chunks_.size()) {
+                // A free chunk too small for the request stays unused until the scope ends
+                ++chunk_;
+                offset_ = 0;
+                continue;
+            }
+        }
+        const size_t size = max(next_chunk_size_, bytes + alignment - 1);
+        chunks_.push_back({ make_unique<byte[]>(size), size });
+        next_chunk_size_ = size * 2;
+        ++stats_.upstream_allocations;
+        total_upstream_allocations_.fetch_add(1, memory_order_relaxed);
+        stats_.reserved_bytes += size;
+        chunk_ = chunks_.size() - 1;
+        offset_ = 0;
+    }
+}
+
+void ScratchArena::do_deallocate(void*, size_t, size_t) {
+}
+
+bool ScratchArena::do_is_equal(const memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for temporary memory. Deallocation does nothing; a Scope
+// gives back everything allocated during its life at once. Chunks are kept
+// until the arena dies, so once the arena has grown to the largest working
+// set, allocations never reach the upstream allocator again.
+class ScratchArena : public std::pmr::memory_resource {
+public:
+    struct Stats {
+        // Chunks requested from the upstream allocator so far
+        uint64_t upstream_allocations = 0;
+        uint64_t reserved_bytes = 0;
+    };
+
+    // Rewinds the arena to where it was when the scope began. Scopes of one
+    // arena must end in the reverse order of their beginning.
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena);
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope();
+
+    private:
+        ScratchArena& arena_;
+        size_t chunk_;
+        size_t offset_;
+    };
+
+    explicit ScratchArena(size_t chunk_size = INITIAL_CHUNK_SIZE);
+
+    Stats GetStats() const;
+
+    // Arena of the calling thread, used for the scratch memory of queries
+    // and of document tokenization
+    static ScratchArena& GetThreadArena();
+
+    // Chunks requested from the upstream allocator by all arenas. Memory
+    // allocated outside the arenas, such as result vectors, is not counted.
+    static uint64_t GetTotalUpstreamAllocations();
+
+private:
+    inline static constexpr size_t INITIAL_CHUNK_SIZE = 64 << 10;
+
+    struct Chunk {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    // Chunks after the current one are free
+    std::vector<Chunk> chunks_;
+    size_t chunk_ = 0;
+    size_t offset_ = 0;
+    size_t next_chunk_size_;
+    Stats stats_;
+
+    inline static std::atomic<uint64_t> total_upstream_allocations_{ 0 };
+};
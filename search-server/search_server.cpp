@@ -1,4 +1,8 @@
 #include "search_server.h"
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
 using namespace std;
 
 SearchServer::SearchServer(const string& stop_words_text)
@@ -6,75 +10,275 @@ SearchServer::SearchServer(const string& stop_words_text)
 {
 }
 
-SearchServer::SearchServer(std::string_view stop_words_text) {
-    vector<string_view> stops = SplitIntoWords(stop_words_text);
-    for (string_view stop_w : stops) {
-        stop_words_.insert(string{ stop_w });
-    }
+SearchServer::SearchServer(std::string_view stop_words_text)
+    : stop_words_(SplitIntoWords(stop_words_text))
+{
 }
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if (!IsValidWord(document)) {
+    // Scratch memory of the document comes from the thread's arena
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    pmr::vector<string_view> words(&arena);
+    if (!SplitIntoWordsNoStop(document, words)) {
         throw invalid_argument("Документ содержит недопустимые символы."s);
     }
     else if (document_id < 0) {
         throw invalid_argument("Невозможно добавить документ с отрицательным id."s);
     }
-    else if (documents_.count(document_id) > 0) {
+    else if (ordinals_.count(document_id) > 0) {
         throw invalid_argument("Документ с таким id уже был добавлен."s);
     }
+    else if (!IsValidStatus(status)) {
+        throw invalid_argument("Недопустимый статус документа."s);
+    }
     else {
-        const vector<string_view> words = SplitIntoWordsNoStop(document);
-        const double inv_word_count = 1.0 / words.size();
-        for (string_view word : words) {
-            server_dictionary_.push_back(string{word});
-            word_to_document_freqs_[server_dictionary_[server_dictionary_.size()-1]][document_id] += inv_word_count;
-            word_frequency_[document_id][server_dictionary_[server_dictionary_.size() - 1]] += inv_word_count;
+        const double inv_word_count = ComputeInverseWordCount(words.size());
+        // Equal words become runs, counted in place of a map
+        sort(words.begin(), words.end());
+        pmr::vector<pair<string_view, uint32_t>> word_counts(&arena);
+        DocumentFingerprint fingerprint;
+        for (size_t i = 0; i < words.size();) {
+            const size_t j = upper_bound(words.begin() + i, words.end(), words[i]) - words.begin();
+            word_counts.emplace_back(words[i], static_cast<uint32_t>(j - i));
+            fingerprint.AddWord(words[i]);
+            i = j;
+        }
+        if (reject_duplicates_ && fingerprint_counts_.count(fingerprint) > 0) {
+            throw invalid_argument("Документ совпадает с уже добавленным."s);
+        }
+        const int ordinal = static_cast<int>(documents_index_.size());
+        pmr::vector<ForwardIndex::Entry> terms(&arena);
+        terms.reserve(word_counts.size());
+        for (const auto& [word, count] : word_counts) {
+            const int term_id = dictionary_.Intern(word);
+            if (term_id >= static_cast<int>(buffer_postings_.size())) {
+                buffer_postings_.resize(term_id + 1);
+            }
+            buffer_postings_[term_id].Append(ordinal, count);
+            UpdateDocumentFreq(term_id);
+            UpdateMaxTermFreq(term_id, count * inv_word_count);
+            terms.push_back({ term_id, count });
+        }
+        sort(terms.begin(), terms.end(), [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) {
+            return lhs.term_id < rhs.term_id;
+            });
+        forward_index_.Append(terms.data(), terms.size());
+        AppendDocument(document_id, ComputeAverageRating(ratings), status, fingerprint);
+        inverse_word_counts_.push_back(inv_word_count);
+        RefreshIdfDocumentCount();
+        UpdateGeneration();
+        buffer_posting_count_ += word_counts.size();
+        if (buffer_posting_count_ >= BUFFER_POSTING_LIMIT) {
+            Flush();
+        }
+    }
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    if (documents.empty()) {
+        return;
+    }
+    vector<int> batch_ids;
+    batch_ids.reserve(documents.size());
+    for (const NewDocument& document : documents) {
+        if (document.id < 0) {
+            throw invalid_argument("Невозможно добавить документ с отрицательным id."s);
+        }
+        else if (ordinals_.count(document.id) > 0) {
+            throw invalid_argument("Документ с таким id уже был добавлен."s);
+        }
+        else if (!IsValidStatus(document.status)) {
+            throw invalid_argument("Недопустимый статус документа."s);
+        }
+        batch_ids.push_back(document.id);
+    }
+    sort(batch_ids.begin(), batch_ids.end());
+    if (adjacent_find(batch_ids.begin(), batch_ids.end()) != batch_ids.end()) {
+        throw invalid_argument("Документ с таким id уже был добавлен."s);
+    }
+
+    // The calling thread tokenizes runs too
+    const size_t run_count = min(documents.size(), (thread_pool_->GetThreadCount() + 1) * SHARDS_PER_THREAD);
+    vector<PartialIndex> runs(run_count);
+    auto get_run_begin = [&](size_t run) {
+        return documents.size() * run / run_count;
+    };
+    thread_pool_->ParallelFor(run_count, [&](size_t run) {
+        BuildPartialIndex(documents, get_run_begin(run), get_run_begin(run + 1), runs[run]);
+        });
+
+    vector<DocumentFingerprint> fingerprints;
+    fingerprints.reserve(documents.size());
+    for (const PartialIndex& index : runs) {
+        fingerprints.insert(fingerprints.end(), index.fingerprints.begin(), index.fingerprints.end());
+    }
+    if (reject_duplicates_) {
+        unordered_set<DocumentFingerprint, DocumentFingerprintHasher> batch_fingerprints;
+        for (const DocumentFingerprint& fingerprint : fingerprints) {
+            if (fingerprint_counts_.count(fingerprint) > 0 || !batch_fingerprints.insert(fingerprint).second) {
+                throw invalid_argument("Документ совпадает с уже добавленным."s);
+            }
+        }
+    }
+
+    // Merging the runs in order keeps every posting list sorted by ordinal
+    const int first_ordinal = static_cast<int>(documents_index_.size());
+    for (PartialIndex& index : runs) {
+        vector<int> term_ids(index.words.size());
+        for (size_t local_term = 0; local_term < index.words.size(); ++local_term) {
+            const auto& term_postings = index.postings[local_term];
+            const int term_id = dictionary_.Intern(index.words[local_term], static_cast<int>(term_postings.size()));
+            if (term_id >= static_cast<int>(buffer_postings_.size())) {
+                buffer_postings_.resize(term_id + 1);
+            }
+            PostingList& postings = buffer_postings_[term_id];
+            for (const auto& [position, count] : term_postings) {
+                postings.Append(first_ordinal + position, count);
+            }
+            buffer_posting_count_ += term_postings.size();
+            UpdateDocumentFreq(term_id);
+            term_ids[local_term] = term_id;
+        }
+        for (size_t i = 0; i + 1 < index.document_offsets.size(); ++i) {
+            for (size_t j = index.document_offsets[i]; j < index.document_offsets[i + 1]; ++j) {
+                ForwardIndex::Entry& entry = index.document_terms[j];
+                entry.term_id = term_ids[entry.term_id];
+                UpdateMaxTermFreq(entry.term_id, entry.count * index.inverse_word_counts[i]);
+            }
+        }
+        index.postings.clear();
+    }
+    // Global ids are in another order than the local ones
+    thread_pool_->ParallelFor(run_count, [&](size_t run) {
+        PartialIndex& index = runs[run];
+        for (size_t i = 0; i + 1 < index.document_offsets.size(); ++i) {
+            sort(index.document_terms.begin() + index.document_offsets[i], index.document_terms.begin() + index.document_offsets[i + 1],
+                [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) {
+                    return lhs.term_id < rhs.term_id;
+                });
+        }
+        });
+    for (const PartialIndex& index : runs) {
+        for (size_t i = 0; i + 1 < index.document_offsets.size(); ++i) {
+            forward_index_.Append(index.document_terms.data() + index.document_offsets[i], index.document_offsets[i + 1] - index.document_offsets[i]);
+        }
+    }
+
+    const size_t ordinal_bound = documents_index_.size() + documents.size();
+    documents_index_.reserve(ordinal_bound);
+    ratings_.reserve(ordinal_bound);
+    statuses_.reserve(ordinal_bound);
+    fingerprints_.reserve(ordinal_bound);
+    inverse_word_counts_.reserve(ordinal_bound);
+    ordinals_.reserve(ordinals_.size() + documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        AppendDocument(document.id, ComputeAverageRating(document.ratings), document.status, fingerprints[i]);
+    }
+    for (const PartialIndex& index : runs) {
+        inverse_word_counts_.insert(inverse_word_counts_.end(), index.inverse_word_counts.begin(), index.inverse_word_counts.end());
+    }
+    RefreshIdfDocumentCount();
+    UpdateGeneration();
+    if (buffer_posting_count_ >= BUFFER_POSTING_LIMIT) {
+        Flush();
+    }
+}
 
+void SearchServer::BuildPartialIndex(const vector<NewDocument>& documents, size_t begin, size_t end, PartialIndex& index) const {
+    unordered_map<string_view, int> local_terms;
+    index.document_offsets.reserve(end - begin + 1);
+    index.document_offsets.push_back(0);
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    pmr::vector<string_view> words(&arena);
+    for (size_t position = begin; position < end; ++position) {
+        if (!SplitIntoWordsNoStop(documents[position].text, words)) {
+            throw invalid_argument("Документ содержит недопустимые символы."s);
         }
-        documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-        documents_index_.push_back(document_id);
-        documents_id_.insert(document_id);
+        index.inverse_word_counts.push_back(ComputeInverseWordCount(words.size()));
+        sort(words.begin(), words.end());
+        DocumentFingerprint fingerprint;
+        for (size_t i = 0; i < words.size();) {
+            const size_t j = upper_bound(words.begin() + i, words.end(), words[i]) - words.begin();
+            const uint32_t count = static_cast<uint32_t>(j - i);
+            fingerprint.AddWord(words[i]);
+            const auto [it, inserted] = local_terms.emplace(words[i], static_cast<int>(index.words.size()));
+            if (inserted) {
+                index.words.push_back(words[i]);
+                index.postings.emplace_back();
+            }
+            index.postings[it->second].emplace_back(static_cast<int>(position), count);
+            index.document_terms.push_back({ it->second, count });
+            i = j;
+        }
+        index.document_offsets.push_back(index.document_terms.size());
+        index.fingerprints.push_back(fingerprint);
     }
 }
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(execution::seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status; });
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, int max_result_count) const {
+    return FindTopDocuments(execution::seq, raw_query, status, max_result_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
     return FindTopDocuments(execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+SearchServer::PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    PreparedQuery prepared;
+    prepared.text_ = make_shared<const string>(raw_query);
+    prepared.query_ = ParseQuery(*prepared.text_, false);
+    return prepared;
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status, int max_result_count) const {
+    return FindTopDocuments(execution::seq, query, status, max_result_count);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter, int max_result_count) const {
+    return FindTopDocuments(execution::seq, raw_query, filter, max_result_count);
+}
+
+int SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, Document* output, int max_result_count) const {
+    return FindTopDocuments(raw_query, DocumentFilter::ByStatus(status), output, max_result_count);
+}
+
+int SearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter, Document* output, int max_result_count) const {
+    const ParsedQuery query(*this, raw_query, false);
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    pmr::vector<uint64_t> mask(&arena);
+    TopDocuments top_documents(output, max_result_count);
+    FindAllDocuments(*query, MakeBitsetPredicate(GetFilterBitset(filter, mask)), top_documents);
+    return top_documents.Finish();
+}
 
 int SearchServer::GetDocumentCount() const {
-    int x = static_cast<int>(documents_.size());
-    return x;
+    return static_cast<int>(ordinals_.size());
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
     if (!documents_id_.count(document_id)) {
         throw out_of_range("Недействительный id документа"s);
     }
-    const Query query = ParseQuery(raw_query, false);
+    const ParsedQuery query(*this, raw_query, false);
+    const int ordinal = GetOrdinal(document_id);
+    const ArrayView<ForwardIndex::Entry> terms = forward_index_.Get(ordinal);
     vector<string_view> matched_words;
-    for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word)) {
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                matched_words.clear();
-                return { matched_words, documents_.at(document_id).status };
-            }
+    for (string_view word : query->minus_words) {
+        if (ForwardIndex::Contains(terms, dictionary_.Find(word))) {
+            matched_words.clear();
+            return { matched_words, statuses_[ordinal] };
         }
     }
-    for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word)) {
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                matched_words.push_back(word);
-            }
+    for (string_view word : query->plus_words) {
+        if (ForwardIndex::Contains(terms, dictionary_.Find(word))) {
+            matched_words.push_back(word);
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, statuses_[ordinal] };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, std::string_view raw_query, int document_id) const {
@@ -86,33 +290,30 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const std
     if (!documents_id_.count(document_id)) {
         throw out_of_range("Недействительный id документа"s);
     }
-    const Query query = ParseQuery(raw_query, true);
+    const ParsedQuery query(*this, raw_query, true);
+    const int ordinal = GetOrdinal(document_id);
+    const ArrayView<ForwardIndex::Entry> terms = forward_index_.Get(ordinal);
 
-    auto minus = any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), [this, &document_id](string_view word)
-        {if (word_to_document_freqs_.count(word)) {
-        return (word_to_document_freqs_.at(word).count(document_id) != 0);
-    } return false; });
+    auto minus = any_of(execution::par, query->minus_words.begin(), query->minus_words.end(), [this, terms](string_view word)
+        { return ForwardIndex::Contains(terms, dictionary_.Find(word)); });
 
     if (minus) {
         vector<string_view> matched_words = {};
-        return { matched_words, documents_.at(document_id).status };
+        return { matched_words, statuses_[ordinal] };
     }
 
-    vector<string_view> matched_words(query.plus_words.size());
+    vector<string_view> matched_words(query->plus_words.size());
 
-    auto words_end = copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(),
+    auto words_end = copy_if(execution::par, query->plus_words.begin(), query->plus_words.end(),
         matched_words.begin(),
-        [this, &document_id](auto word) {
-            if (word_to_document_freqs_.count(word)) {
-                return word_to_document_freqs_.at(word).count(document_id) != 0;
-            }
-    return false; });
+        [this, terms](auto word) {
+            return ForwardIndex::Contains(terms, dictionary_.Find(word)); });
 
     sort(matched_words.begin(), words_end);
     words_end = unique(matched_words.begin(), words_end);
     matched_words.erase(words_end, matched_words.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, statuses_[ordinal] };
 }
 
 std::set<int>::const_iterator SearchServer::begin() const {
@@ -124,19 +325,47 @@ std::set<int>::const_iterator SearchServer::end() const {
     return documents_id_.end();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    return word_frequency_.at(document_id);
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    const int ordinal = GetOrdinal(document_id);
+    map<string_view, double> word_freqs;
+    for (const auto [term_id, count] : forward_index_.Get(ordinal)) {
+        word_freqs.emplace(dictionary_.GetWord(term_id), count * inverse_word_counts_[ordinal]);
+    }
+    return word_freqs;
+}
+
+ArrayView<ForwardIndex::Entry> SearchServer::GetDocumentTerms(int document_id) const {
+    return forward_index_.Get(GetOrdinal(document_id));
+}
+
+string_view SearchServer::GetTermWord(int term_id) const {
+    return dictionary_.GetWord(term_id);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    documents_.erase(document_id);
-    documents_id_.erase(document_id);
-    map<string_view, double> words_to_delete = GetWordFrequencies(document_id);
-    for (const auto& [word, id] : words_to_delete) {
-        word_to_document_freqs_.at(word).erase(document_id);
-        if (word_to_document_freqs_.at(word).empty()) { word_to_document_freqs_.erase(word); }
+    const int ordinal = GetOrdinal(document_id);
+    const auto fingerprint_count = fingerprint_counts_.find(fingerprints_[ordinal]);
+    if (--fingerprint_count->second == 0) {
+        fingerprint_counts_.erase(fingerprint_count);
     }
-    if (word_frequency_.count(document_id)) { word_frequency_.erase(document_id); }
+    removed_ordinals_[ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+    status_ordinals_[static_cast<int>(statuses_[ordinal])][ordinal / 64] &= ~(uint64_t{ 1 } << (ordinal % 64));
+    for (const auto [term_id, _] : forward_index_.Get(ordinal)) {
+        if (dictionary_.Release(term_id)) {
+            // Only removed documents are left in the postings of a freed term
+            if (term_id < static_cast<int>(buffer_postings_.size())) {
+                buffer_postings_[term_id].clear();
+            }
+            max_term_freqs_[term_id] = 0.0;
+        }
+        else {
+            UpdateDocumentFreq(term_id);
+        }
+    }
+    ordinals_.erase(document_id);
+    documents_id_.erase(document_id);
+    RefreshIdfDocumentCount();
+    UpdateGeneration();
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy exec, int document_id) {
@@ -144,28 +373,229 @@ void SearchServer::RemoveDocument(std::execution::sequenced_policy exec, int doc
 }
 
 void SearchServer::RemoveDocument(execution::parallel_policy policy, int document_id) {
-    if (!documents_.count(document_id)) {
+    if (ordinals_.count(document_id)) {
+        RemoveDocument(document_id);
+    }
+}
+
+void SearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = move(thread_pool);
+}
+
+void SearchServer::SetIdfTolerance(double tolerance) {
+    if (!(tolerance >= 0.0)) {
+        throw invalid_argument("Допуск IDF должен быть неотрицательным."s);
+    }
+    idf_tolerance_ = tolerance;
+    RefreshIdfDocumentCount();
+    UpdateGeneration();
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_ = capacity > 0 ? make_shared<ResultCache>(capacity) : nullptr;
+}
+
+ResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : ResultCache::Stats{};
+}
+
+DocumentFingerprint SearchServer::GetDocumentFingerprint(int document_id) const {
+    return fingerprints_[GetOrdinal(document_id)];
+}
+
+uint64_t SearchServer::ComputeSimHash(int document_id) const {
+    const int ordinal = GetOrdinal(document_id);
+    SimHashBuilder sim_hash;
+    for (const auto [term_id, count] : forward_index_.Get(ordinal)) {
+        sim_hash.AddWord(dictionary_.GetWord(term_id), count * inverse_word_counts_[ordinal]);
+    }
+    return sim_hash.Get();
+}
+
+void SearchServer::SetRejectDuplicates(bool reject) {
+    reject_duplicates_ = reject;
+}
+
+const shared_ptr<ThreadPool>& SearchServer::GetThreadPool() const {
+    return thread_pool_;
+}
+
+int SearchServer::GetRemovedDocumentCount() const {
+    return static_cast<int>(documents_index_.size() - ordinals_.size());
+}
+
+void SearchServer::Compact() {
+    if (GetRemovedDocumentCount() == 0) {
         return;
     }
-    if (word_frequency_.count(document_id)) {
-        auto& words_to_delete = word_frequency_.at(document_id);
-        vector<string_view*> words;
-        words.reserve(words_to_delete.size());
-        for (const auto& word : words_to_delete) {
-            words.push_back(move(const_cast<string_view*>(&word.first)));
+    // Surviving documents keep their relative order, so the posting lists stay sorted
+    vector<int> new_ordinals(documents_index_.size(), -1);
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
+    int new_ordinal_bound = 0;
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        if (!IsRemoved(ordinal)) {
+            new_ordinals[ordinal] = new_ordinal_bound++;
+        }
+    }
+    auto segment = IndexSegment::Build(0, new_ordinal_bound, dictionary_.GetIdBound(),
+        [this, ordinal_bound](int term_id, auto func) {
+            ForEachPostingBlock(term_id, 0, ordinal_bound, func);
+        },
+        [&new_ordinals](int ordinal) {
+            return new_ordinals[ordinal];
+        }, *thread_pool_);
+    segments_.clear();
+    if (segment->GetPostingCount() > 0) {
+        segments_.push_back(move(segment));
+    }
+    buffer_postings_.clear();
+    buffer_posting_count_ = 0;
+    buffer_ordinal_begin_ = new_ordinal_bound;
+    // The surviving attributes move down in place
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        const int new_ordinal = new_ordinals[ordinal];
+        if (new_ordinal >= 0) {
+            documents_index_[new_ordinal] = documents_index_[ordinal];
+            ratings_[new_ordinal] = ratings_[ordinal];
+            statuses_[new_ordinal] = statuses_[ordinal];
+            fingerprints_[new_ordinal] = fingerprints_[ordinal];
+            inverse_word_counts_[new_ordinal] = inverse_word_counts_[ordinal];
         }
-        //for_each(execution::par, words_to_delete.begin(), words_to_delete.end(), [&words] (const auto& word) {words.push_back(move(const_cast<string*>(&word.first)));});
-        for_each(execution::par, words.begin(), words.end(), [this, &document_id](string_view* word) {word_to_document_freqs_.at(*word).erase(document_id); });
-        word_frequency_.erase(document_id);
     }
-    documents_.erase(document_id);
-    documents_id_.erase(find(execution::par, documents_id_.begin(), documents_id_.end(), document_id));
+    documents_index_.resize(new_ordinal_bound);
+    ratings_.resize(new_ordinal_bound);
+    statuses_.resize(new_ordinal_bound);
+    fingerprints_.resize(new_ordinal_bound);
+    inverse_word_counts_.resize(new_ordinal_bound);
+    for (auto& [document_id, ordinal] : ordinals_) {
+        ordinal = new_ordinals[ordinal];
+    }
+    forward_index_.Compact(new_ordinals);
+    removed_ordinals_.assign((documents_index_.size() + 63) / 64, 0);
+    for (vector<uint64_t>& bitset : status_ordinals_) {
+        bitset.assign(removed_ordinals_.size(), 0);
+    }
+    for (int ordinal = 0; ordinal < new_ordinal_bound; ++ordinal) {
+        status_ordinals_[static_cast<int>(statuses_[ordinal])][ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+    }
+    ComputeMaxTermFreqs();
+    // The whole index is rewritten, so results cached before are not reused
+    UpdateGeneration();
 }
 
+void SearchServer::Flush() {
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
+    if (buffer_ordinal_begin_ == ordinal_bound) {
+        return;
+    }
+    // Documents removed while in the buffer never reach a segment
+    auto segment = IndexSegment::Build(buffer_ordinal_begin_, ordinal_bound, static_cast<int>(buffer_postings_.size()),
+        [this](int term_id, auto func) {
+            func(buffer_postings_[term_id].GetOrdinals(), buffer_postings_[term_id].GetCounts());
+        },
+        [this](int ordinal) {
+            return IsRemoved(ordinal) ? -1 : ordinal;
+        }, *thread_pool_);
+    if (segment->GetPostingCount() > 0) {
+        segments_.push_back(move(segment));
+    }
+    buffer_postings_.clear();
+    buffer_posting_count_ = 0;
+    buffer_ordinal_begin_ = ordinal_bound;
+    MergeSegments();
+}
 
+int SearchServer::GetSegmentCount() const {
+    return static_cast<int>(segments_.size());
+}
+
+int SearchServer::GetSegmentTier(size_t posting_count) {
+    int tier = 0;
+    for (size_t tier_limit = BUFFER_POSTING_LIMIT * MERGE_FACTOR; posting_count >= tier_limit; tier_limit *= MERGE_FACTOR) {
+        ++tier;
+    }
+    return tier;
+}
+
+void SearchServer::MergeSegments() {
+    while (segments_.size() >= MERGE_FACTOR) {
+        const auto first = segments_.end() - MERGE_FACTOR;
+        const int tier = GetSegmentTier((*first)->GetPostingCount());
+        if (any_of(first, segments_.end(), [tier](const shared_ptr<const IndexSegment>& segment) {
+            return GetSegmentTier(segment->GetPostingCount()) != tier;
+            })) {
+            break;
+        }
+        // Neighbouring segments cover adjacent ordinal ranges, so their
+        // postings are concatenated in order; removed documents are dropped
+        const vector<shared_ptr<const IndexSegment>> merged(first, segments_.end());
+        auto segment = IndexSegment::Build(merged.front()->GetOrdinalBegin(), merged.back()->GetOrdinalEnd(), dictionary_.GetIdBound(),
+            [&merged](int term_id, auto func) {
+                for (const shared_ptr<const IndexSegment>& segment : merged) {
+                    ForEachSegmentBlock(*segment, term_id, 0, segment->GetOrdinalEnd(), func);
+                }
+            },
+            [this](int ordinal) {
+                return IsRemoved(ordinal) ? -1 : ordinal;
+            }, *thread_pool_);
+        segments_.erase(first, segments_.end());
+        if (segment->GetPostingCount() > 0) {
+            segments_.push_back(move(segment));
+        }
+    }
+}
+
+int SearchServer::GetOrdinal(int document_id) const {
+    return ordinals_.at(document_id);
+}
+
+void SearchServer::AppendDocument(int document_id, int rating, DocumentStatus status, const DocumentFingerprint& fingerprint) {
+    const int ordinal = static_cast<int>(documents_index_.size());
+    ordinals_.emplace(document_id, ordinal);
+    documents_index_.push_back(document_id);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    fingerprints_.push_back(fingerprint);
+    ++fingerprint_counts_[fingerprint];
+    documents_id_.insert(document_id);
+    ResizeOrdinalBitsets();
+    status_ordinals_[static_cast<int>(status)][ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+}
+
+void SearchServer::ResizeOrdinalBitsets() {
+    const size_t size = (documents_index_.size() + 63) / 64;
+    removed_ordinals_.resize(size);
+    for (vector<uint64_t>& bitset : status_ordinals_) {
+        bitset.resize(size);
+    }
+}
+
+const uint64_t* SearchServer::GetFilterBitset(const DocumentFilter& filter, pmr::vector<uint64_t>& mask) const {
+    const uint32_t statuses = filter.statuses & DocumentFilter::ALL_STATUSES;
+    if ((statuses & (statuses - 1)) == 0 && statuses != 0 && !filter.HasRatingRange()) {
+        return status_ordinals_[CountTrailingZeros(statuses)].data();
+    }
+    mask.assign(removed_ordinals_.size(), 0);
+    for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if ((statuses >> status & 1) != 0) {
+            const vector<uint64_t>& bitset = status_ordinals_[status];
+            for (size_t i = 0; i < mask.size(); ++i) {
+                mask[i] |= bitset[i];
+            }
+        }
+    }
+    if (filter.HasRatingRange()) {
+        FilterRatings(ratings_.data(), ratings_.size(), filter.min_rating, filter.max_rating, mask.data());
+    }
+    return mask.data();
+}
 
 bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
+}
+
+bool SearchServer::IsValidStatus(DocumentStatus status) {
+    return static_cast<int>(status) >= 0 && static_cast<int>(status) < DOCUMENT_STATUS_COUNT;
 }
 
 bool SearchServer::IsValidWord(string_view word) {
@@ -175,14 +605,17 @@ bool SearchServer::IsValidWord(string_view word) {
         });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (string_view word : SplitIntoWords(text)) {
+bool SearchServer::SplitIntoWordsNoStop(string_view text, pmr::vector<string_view>& words) const {
+    words.clear();
+    return ForEachWord(text, [this, &words](string_view word) {
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
-    return words;
+        });
+}
+
+double SearchServer::ComputeInverseWordCount(size_t word_count) {
+    return word_count == 0 ? 0.0 : 1.0 / word_count;
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -193,48 +626,267 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
-    bool is_minus = false;
-    // Word shouldn't be empty
-    if (text[0] == '-') {
-        is_minus = true;
-        text = text.substr(1);
+void SearchServer::ParseQuery(string_view text, bool skip_sort, Query& query) const {
+    query.plus_words.clear();
+    query.minus_words.clear();
+    // A trailing minus is reported before any other error, as it always was
+    if (!text.empty() && text.back() == '-') {
+        throw invalid_argument("Отсутствие текста после символа «минус»"s);
     }
-    return { text, is_minus, IsStopWord(text) };
-}
-
-SearchServer::Query SearchServer::ParseQuery(string_view text, bool skip_sort) const {
-    for (size_t i = 0; i < text.size(); i++) {
-        if (text[i] == '-' && text[i + 1] == '-') {
-            throw invalid_argument("Добавлено два символа «минус» подряд"s);
+    bool has_invalid_chars = false;
+    size_t word_begin = 0;
+    for (size_t pos = FindSeparator(text, 0, '-'); pos < text.size(); pos = FindSeparator(text, pos + 1, '-')) {
+        if (text[pos] == ' ') {
+            AddQueryWord(text.substr(word_begin, pos - word_begin), query);
+            word_begin = pos + 1;
         }
-        else if ((text[i] == '-' && text[i + 1] == ' ') || (text[text.size() - 1] == '-')) {
-            throw invalid_argument("Отсутствие текста после символа «минус»"s);
-        }
-    }
-    if (!IsValidWord(text)) { throw invalid_argument("Текст запроса содержит недопустимые символы"s); }
-    Query query;
-    for (string_view word : SplitIntoWords(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
+        else if (text[pos] == '-') {
+            if (pos + 1 < text.size() && text[pos + 1] == '-') {
+                throw invalid_argument("Добавлено два символа «минус» подряд"s);
             }
-            else {
-                query.plus_words.push_back(query_word.data);
+            else if (pos + 1 == text.size() || text[pos + 1] == ' ') {
+                throw invalid_argument("Отсутствие текста после символа «минус»"s);
             }
         }
+        else {
+            // Reported only if the minuses are fine
+            has_invalid_chars = true;
+        }
+    }
+    if (has_invalid_chars) {
+        throw invalid_argument("Текст запроса содержит недопустимые символы"s);
     }
+    AddQueryWord(text.substr(word_begin), query);
     if (!skip_sort) {
         for (auto* words : { &query.minus_words, &query.plus_words }) {
             sort(words->begin(), words->end());
             words->erase(unique(words->begin(), words->end()), words->end());
         }
     }
+}
+
+SearchServer::Query SearchServer::ParseQuery(string_view text, bool skip_sort) const {
+    Query query;
+    ParseQuery(text, skip_sort, query);
     return query;
 }
 
+void SearchServer::AddQueryWord(string_view word, Query& query) const {
+    if (word.empty()) {
+        return;
+    }
+    const bool is_minus = word[0] == '-';
+    if (is_minus) {
+        word.remove_prefix(1);
+    }
+    if (!IsStopWord(word)) {
+        (is_minus ? query.minus_words : query.plus_words).push_back(word);
+    }
+}
+
+SearchServer::ParsedQuery::ParsedQuery(const SearchServer& server, string_view text, bool skip_sort) {
+    Storage& storage = GetStorage();
+    if (storage.used == storage.queries.size()) {
+        storage.queries.push_back(make_unique<Query>());
+    }
+    query_ = storage.queries[storage.used].get();
+    server.ParseQuery(text, skip_sort, *query_);
+    // The slot is taken only after parsing succeeds: a throwing constructor skips the destructor
+    ++storage.used;
+}
+
+SearchServer::ParsedQuery::~ParsedQuery() {
+    --GetStorage().used;
+}
+
+SearchServer::ParsedQuery::Storage& SearchServer::ParsedQuery::GetStorage() {
+    thread_local Storage storage;
+    return storage;
+}
+
 // Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+double SearchServer::ComputeWordInverseDocumentFreq(int term_id) const {
+    return log_idf_document_count_ - log_document_freqs_[term_id];
+}
+
+void SearchServer::UpdateGeneration() {
+    static atomic<uint64_t> last_generation{ 0 };
+    generation_ = last_generation.fetch_add(1, memory_order_relaxed) + 1;
+}
+
+string SearchServer::MakeResultCacheKey(const Query& query, const DocumentFilter& filter, int max_result_count) const {
+    string key(reinterpret_cast<const char*>(&generation_), sizeof(generation_));
+    key += static_cast<char>(filter.statuses & DocumentFilter::ALL_STATUSES);
+    key.append(reinterpret_cast<const char*>(&filter.min_rating), sizeof(filter.min_rating));
+    key.append(reinterpret_cast<const char*>(&filter.max_rating), sizeof(filter.max_rating));
+    key.append(reinterpret_cast<const char*>(&max_result_count), sizeof(max_result_count));
+    // Query words contain neither spaces nor leading minuses
+    for (string_view word : query.plus_words) {
+        key += ' ';
+        key += word;
+    }
+    for (string_view word : query.minus_words) {
+        key += " -"s;
+        key += word;
+    }
+    return key;
+}
+
+void SearchServer::UpdateDocumentFreq(int term_id) {
+    if (term_id >= static_cast<int>(log_document_freqs_.size())) {
+        log_document_freqs_.resize(term_id + 1);
+    }
+    log_document_freqs_[term_id] = log(dictionary_.GetRefCount(term_id));
+}
+
+void SearchServer::UpdateMaxTermFreq(int term_id, double term_freq) {
+    if (term_id >= static_cast<int>(max_term_freqs_.size())) {
+        max_term_freqs_.resize(term_id + 1, 0.0);
+    }
+    max_term_freqs_[term_id] = max(max_term_freqs_[term_id], term_freq);
+}
+
+void SearchServer::ComputeMaxTermFreqs() {
+    max_term_freqs_.assign(dictionary_.GetIdBound(), 0.0);
+    for (int ordinal = 0; ordinal < static_cast<int>(documents_index_.size()); ++ordinal) {
+        if (!IsRemoved(ordinal)) {
+            for (const auto [term_id, count] : forward_index_.Get(ordinal)) {
+                UpdateMaxTermFreq(term_id, count * inverse_word_counts_[ordinal]);
+            }
+        }
+    }
+}
+
+void SearchServer::RefreshIdfDocumentCount() {
+    const int document_count = GetDocumentCount();
+    if (abs(document_count - idf_document_count_) > idf_tolerance_ * idf_document_count_) {
+        idf_document_count_ = document_count;
+        log_idf_document_count_ = log(document_count);
+    }
+}
+
+ScoreAccumulator& SearchServer::GetScoreAccumulator() const {
+    thread_local ScoreAccumulator accumulator;
+    accumulator.Reset(static_cast<int>(documents_index_.size()));
+    return accumulator;
+}
+
+pmr::vector<SearchServer::ScoredTerm> SearchServer::FindScoredTerms(const vector<string_view>& words, pmr::memory_resource* resource) const {
+    pmr::vector<ScoredTerm> terms(resource);
+    terms.reserve(words.size());
+    for (string_view word : words) {
+        const int term_id = dictionary_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(term_id);
+            terms.push_back({ term_id, inverse_document_freq, max_term_freqs_[term_id] * inverse_document_freq });
+        }
+    }
+    return terms;
+}
+
+double SearchServer::FindThresholdScore(const pmr::vector<int>& ordinals, const ScoreAccumulator& accumulator, int capacity,
+    pmr::vector<double>& heap) {
+    // The least of the best scores is on top of the heap
+    const size_t size = static_cast<size_t>(capacity);
+    heap.clear();
+    for (const int ordinal : ordinals) {
+        const double score = accumulator.GetScore(ordinal);
+        if (heap.size() < size) {
+            heap.push_back(score);
+            push_heap(heap.begin(), heap.end(), greater<>());
+        }
+        else if (score > heap.front()) {
+            pop_heap(heap.begin(), heap.end(), greater<>());
+            heap.back() = score;
+            push_heap(heap.begin(), heap.end(), greater<>());
+        }
+    }
+    return heap.size() < size ? -numeric_limits<double>::infinity() : heap.front();
+}
+
+double SearchServer::ComputeRelevance(const pmr::vector<ScoredTerm>& terms, int ordinal) const {
+    const ArrayView<ForwardIndex::Entry> entries = forward_index_.Get(ordinal);
+    double relevance = 0.0;
+    for (const ScoredTerm& term : terms) {
+        const uint32_t count = ForwardIndex::GetCount(entries, term.term_id);
+        if (count > 0) {
+            relevance += count * inverse_word_counts_[ordinal] * term.inverse_document_freq;
+        }
+    }
+    return relevance;
+}
+
+pmr::vector<int> SearchServer::FindTermIds(const vector<string_view>& words, pmr::memory_resource* resource) const {
+    pmr::vector<int> term_ids(resource);
+    term_ids.reserve(words.size());
+    for (string_view word : words) {
+        const int term_id = dictionary_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            term_ids.push_back(term_id);
+        }
+    }
+    return term_ids;
+}
+
+int SearchServer::ComputeShardSize(int ordinal_bound) const {
+    // The calling thread works on shards too. Workers beyond the cores would
+    // only preempt each other, so a larger pool gets no more shards.
+    static const int core_count = static_cast<int>(thread::hardware_concurrency());
+    int worker_count = static_cast<int>(thread_pool_->GetThreadCount());
+    if (core_count > 0) {
+        worker_count = min(worker_count, core_count - 1);
+    }
+    const int shard_count = (worker_count + 1) * SHARDS_PER_THREAD;
+    const int shard_size = max(MIN_SHARD_SIZE, (ordinal_bound + shard_count - 1) / shard_count);
+    return (shard_size + ScoreAccumulator::SHARD_ALIGNMENT - 1) / ScoreAccumulator::SHARD_ALIGNMENT * ScoreAccumulator::SHARD_ALIGNMENT;
+}
+
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < MIN) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+SearchServer::TopDocuments::TopDocuments(int capacity)
+    : own_storage_(static_cast<size_t>(max(capacity, 0)))
+    , heap_(own_storage_.data())
+    , capacity_(own_storage_.size())
+{
+}
+
+SearchServer::TopDocuments::TopDocuments(Document* storage, int capacity)
+    : heap_(storage)
+    , capacity_(static_cast<size_t>(max(capacity, 0)))
+{
+}
+
+void SearchServer::TopDocuments::Push(const Document& document) {
+    // The least relevant kept document is on top of the heap
+    if (size_ < capacity_) {
+        heap_[size_++] = document;
+        push_heap(heap_, heap_ + size_, IsMoreRelevant);
+    }
+    else if (capacity_ > 0 && IsMoreRelevant(document, heap_[0])) {
+        pop_heap(heap_, heap_ + size_, IsMoreRelevant);
+        heap_[size_ - 1] = document;
+        push_heap(heap_, heap_ + size_, IsMoreRelevant);
+    }
+}
+
+int SearchServer::TopDocuments::GetCapacity() const {
+    return static_cast<int>(capacity_);
+}
+
+vector<Document> SearchServer::TopDocuments::Extract() {
+    own_storage_.resize(Finish());
+    return move(own_storage_);
+}
+
+int SearchServer::TopDocuments::Finish() {
+    sort_heap(heap_, heap_ + size_, IsMoreRelevant);
+    return static_cast<int>(size_);
+}
@@ -6,15 +6,40 @@
 #include <set>
 #include <stdexcept>
 #include <algorithm>
+#include <array>
 #include <numeric>
 #include <cmath>
+#include <cstdint>
 #include <execution>
+#include <functional>
 #include <iterator>
-#include <deque>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <unordered_map>
 #include "string_processing.h"
 #include "read_input_functions.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "document_filter.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "score_accumulator.h"
+#include "thread_pool.h"
+#include "index_segment.h"
+#include "result_cache.h"
+#include "stop_word_set.h"
+#include "fingerprint.h"
+#include "forward_index.h"
+#include "scratch_arena.h"
+
+// Document of a bulk load. The text has to stay alive only during the call.
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
 
 class SearchServer {
 public:
@@ -30,24 +55,76 @@ public:
 
     explicit SearchServer(std::string_view stop_words_text);
 
+    // Stop words hashed at compile time
+    template <size_t WordCount>
+    explicit SearchServer(const StaticStopWords<WordCount>& stop_words);
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Adds the documents in their order, tokenizing them on the thread pool.
+    // Nothing is added if any of them is rejected.
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    // max_result_count limits the number of returned documents
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const;
 
+    // Filters are checked against bitsets of the documents with every status
+    // instead of per posting, so they are much cheaper than predicates
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Query parsed once and executed many times. Owns a copy of its text.
+    class PreparedQuery;
+
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, const DocumentFilter& filter,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status = DocumentStatus::ACTUAL,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Writes at most max_result_count documents to output, the most relevant
+    // first, and returns their number. With the result cache off and warm
+    // thread arenas, these overloads allocate no heap memory; the others
+    // allocate their result, and the parallel ones the thread pool's jobs.
+    int FindTopDocuments(std::string_view raw_query, DocumentStatus status, Document* output,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter, Document* output,
+        int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
     int GetDocumentCount() const;
 
     using match = std::tuple<std::vector<std::string_view>, DocumentStatus>;
@@ -63,102 +140,510 @@ public:
     std::set<int>::const_iterator end() const;
 
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Terms of the document sorted by id with their numbers of occurrences,
+    // valid until the server changes. GetTermWord gives the words of the ids.
+    ArrayView<ForwardIndex::Entry> GetDocumentTerms(int document_id) const;
 
+    std::string_view GetTermWord(int term_id) const;
+
+    // Removal only marks the document's ordinal as removed; its postings stay
+    // in place and are skipped by queries until Compact
     void RemoveDocument(int document_id);
 
     void RemoveDocument(std::execution::sequenced_policy policy, int document_id);
 
     void RemoveDocument(std::execution::parallel_policy policy, int document_id);
 
+    // Executor for parallel queries and query batches, ThreadPool::GetDefault()
+    // unless another pool is set
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    const std::shared_ptr<ThreadPool>& GetThreadPool() const;
+
+    // Number of removed documents still present in the posting lists
+    int GetRemovedDocumentCount() const;
+
+    // Rewrites the index as one segment without the removed documents,
+    // renumbering the ordinals of the remaining ones
+    void Compact();
+
+    // New documents are indexed in a mutable buffer. Flush freezes it into
+    // an immutable segment, which happens by itself once the buffer reaches
+    // BUFFER_POSTING_LIMIT postings, and merges segments of similar size.
+    void Flush();
+
+    int GetSegmentCount() const;
+
+    // IDF is computed with the document count as of its last refresh, which
+    // happens once the count drifts from it by more than the given fraction.
+    // Zero, the default, refreshes it on every change, so IDF stays exact.
+    void SetIdfTolerance(double tolerance);
+
+    // Caches the results of queries by status in an LRU cache of about the
+    // given number of entries, shared with copies of the server. Any change
+    // of the documents makes the cached results stale. Zero disables it.
+    void SetResultCacheCapacity(size_t capacity);
+
+    // Zero counters when the cache is disabled
+    ResultCache::Stats GetResultCacheStats() const;
+
+    // Fingerprint of the document's distinct words, computed when it was added
+    DocumentFingerprint GetDocumentFingerprint(int document_id) const;
+
+    // SimHash of the document's words weighted by their term frequencies
+    uint64_t ComputeSimHash(int document_id) const;
+
+    // When set, adding a document with the same distinct words as one already
+    // present throws invalid_argument
+    void SetRejectDuplicates(bool reject);
+
+    // Writes the index to a versioned, checksummed binary snapshot
+    void SaveSnapshot(const std::string& path) const;
+
+    // Memory-maps a snapshot. Its postings become one segment read straight
+    // from the mapping, which processes loading the same file share. The
+    // structure is always checked, so a corrupt file throws instead of
+    // crashing; verify also checks the checksum and that the posting lists
+    // and per-term statistics agree with the forward index.
+    static SearchServer LoadSnapshot(const std::string& path, bool verify = false);
+
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
+    SearchServer() = default;
 
+    // Document ids by ordinal, the position at which the document was added
     std::vector<int> documents_index_;
-    std::set<std::string, std::less<>> stop_words_;
-    std::deque<std::string> server_dictionary_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    // Attributes of every document by ordinal, left as they were in removed ones
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<DocumentFingerprint> fingerprints_;
+    // Ordinals of the present documents by id
+    std::unordered_map<int, int> ordinals_;
+    // 1 / number of words of every document by ordinal: the term frequency
+    // of a word is the number of its occurrences times this
+    std::vector<double> inverse_word_counts_;
+    // Bitset of the ordinals of removed documents
+    std::vector<uint64_t> removed_ordinals_;
+    // Bitsets of the ordinals of present documents with every status
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_ordinals_;
+    StopWordSet stop_words_;
+    TermDictionary dictionary_;
+    // Immutable segments in ascending order of their ordinal ranges
+    std::vector<std::shared_ptr<const IndexSegment>> segments_;
+    // Postings of the documents added since the last flush, indexed by term id
+    std::vector<PostingList> buffer_postings_;
+    // First ordinal covered by the buffer
+    int buffer_ordinal_begin_ = 0;
+    // log of the document frequency of every term by term id, kept up to date
+    // by the writers, so a query word's IDF costs a subtraction
+    std::vector<double> log_document_freqs_;
+    // Largest term frequency of every term by term id, an upper bound of it
+    // after removals until Compact
+    std::vector<double> max_term_freqs_;
+    double idf_tolerance_ = 0.0;
+    // Document count IDF is computed with, and its log
+    int idf_document_count_ = 0;
+    double log_idf_document_count_ = 0.0;
+    // Changes with every change of the documents; unique across servers, so
+    // that copies sharing the result cache never mix up their results
+    uint64_t generation_ = 0;
+    std::shared_ptr<ResultCache> result_cache_;
+    // Number of present documents with every fingerprint
+    std::unordered_map<DocumentFingerprint, int, DocumentFingerprintHasher> fingerprint_counts_;
+    bool reject_duplicates_ = false;
+    size_t buffer_posting_count_ = 0;
     std::set<int> documents_id_;
-    std::map<int, std::map<std::string_view, double>> word_frequency_;
+    // Terms of every document by ordinal
+    ForwardIndex forward_index_;
+    std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
+
+    bool IsRemoved(int ordinal) const;
+
+    // Throws out_of_range for an absent document
+    int GetOrdinal(int document_id) const;
+
+    // Appends the attributes of a document with the next ordinal
+    void AppendDocument(int document_id, int rating, DocumentStatus status, const DocumentFingerprint& fingerprint);
+
+    // Sizes the removed ordinals and status bitsets to the current ordinal bound
+    void ResizeOrdinalBitsets();
+
+    // Bitset of the ordinals of present documents the filter accepts, either
+    // one of the status bitsets or one built in mask
+    const uint64_t* GetFilterBitset(const DocumentFilter& filter, std::pmr::vector<uint64_t>& mask) const;
+
+    // Predicate of the ordinal for FindAllDocuments, which also skips removed documents
+    template <typename DocumentPredicate>
+    auto MakeOrdinalPredicate(DocumentPredicate& document_predicate) const;
+
+    static auto MakeBitsetPredicate(const uint64_t* bitset);
 
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop( std::string_view text) const;
+    static bool IsValidStatus(DocumentStatus status);
 
-    static int ComputeAverageRating(const std::vector<int>& ratings);
+    // Replaces words with the words of text that are not stop words. Returns
+    // false if text contains invalid characters.
+    bool SplitIntoWordsNoStop(std::string_view text, std::pmr::vector<std::string_view>& words) const;
 
-    struct QueryWord {
-        std::string_view data;
-        bool is_minus;
-        bool is_stop;
-    };
+    static int ComputeAverageRating(const std::vector<int>& ratings);
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    static double ComputeInverseWordCount(size_t word_count);
 
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
     };
 
+    // Validates and splits the text in one pass, reusing the memory of query
+    void ParseQuery(std::string_view text, bool skip_sort, Query& query) const;
+
     Query ParseQuery(std::string_view text, bool skip_sort) const;
 
+    void AddQueryWord(std::string_view word, Query& query) const;
+
+    // Query parsed into storage of the calling thread, which keeps its
+    // capacity between queries. Nested queries on one thread get their own.
+    class ParsedQuery {
+    public:
+        ParsedQuery(const SearchServer& server, std::string_view text, bool skip_sort);
+
+        ParsedQuery(const ParsedQuery&) = delete;
+        ParsedQuery& operator=(const ParsedQuery&) = delete;
+
+        ~ParsedQuery();
+
+        const Query& operator*() const {
+            return *query_;
+        }
+
+        const Query* operator->() const {
+            return query_;
+        }
+
+    private:
+        struct Storage {
+            std::vector<std::unique_ptr<Query>> queries;
+            size_t used = 0;
+        };
+
+        static Storage& GetStorage();
+
+        Query* query_ = nullptr;
+    };
+
+    // Documents are ordered by relevance, equal within MIN relevances by rating,
+    // and then by id
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+    // Bounded heap of the most relevant documents pushed so far. The heap
+    // lives either in its own vector or in memory supplied by the caller.
+    class TopDocuments {
+    public:
+        explicit TopDocuments(int capacity);
+
+        TopDocuments(Document* storage, int capacity);
+
+        void Push(const Document& document);
+
+        int GetCapacity() const;
+
+        // Relevance of the least relevant kept document once the heap is
+        // full, minus infinity before
+        double GetMinRelevance() const;
+
+        // Returns the kept documents, the most relevant first. Only for a heap
+        // with its own storage.
+        std::vector<Document> Extract();
+
+        // Sorts the kept documents in place, the most relevant first, and
+        // returns their number
+        int Finish();
+
+    private:
+        std::vector<Document> own_storage_;
+        Document* heap_;
+        size_t capacity_;
+        size_t size_ = 0;
+    };
+
     // Existence required
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(int term_id) const;
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+    // Recomputes the cached log of the term's document frequency
+    void UpdateDocumentFreq(int term_id);
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+    void UpdateMaxTermFreq(int term_id, double term_freq);
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query,
-        DocumentPredicate document_predicate) const;
+    // Recomputes the largest term frequencies of the present documents
+    void ComputeMaxTermFreqs();
+
+    // Checks a loaded snapshot against its forward index, throws if it is corrupt
+    void VerifySnapshotIndex(const IndexSegment& segment, const std::vector<bool>& is_live) const;
+
+    // Refreshes the document count IDF is computed with if it is out of tolerance
+    void RefreshIdfDocumentCount();
+
+    // Invalidates the cached query results
+    void UpdateGeneration();
+
+    // Key of a parsed query, whose words are sorted and unique
+    std::string MakeResultCacheKey(const Query& query, const DocumentFilter& filter, int max_result_count) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsByFilter(const ExecutionPolicy& policy, const Query& query, const DocumentFilter& filter,
+        int max_result_count) const;
+
+    // Accumulator of the calling thread, reset for the current ordinals
+    ScoreAccumulator& GetScoreAccumulator() const;
+
+    // Ids of the words present in the index
+    std::pmr::vector<int> FindTermIds(const std::vector<std::string_view>& words, std::pmr::memory_resource* resource) const;
+
+    struct ScoredTerm {
+        int term_id;
+        double inverse_document_freq;
+        // Upper bound of the term's contribution to a relevance
+        double max_score;
+    };
+
+    // Terms of the words present in the index, in the order of the words
+    std::pmr::vector<ScoredTerm> FindScoredTerms(const std::vector<std::string_view>& words, std::pmr::memory_resource* resource) const;
+
+    struct PruningResult {
+        // Set if the terms were scored out of order or only in part: the
+        // scores are then partial, and documents are rescored to be pushed
+        bool rescore = false;
+        // Documents with lower partial scores cannot reach the top documents
+        double min_partial_score = 0.0;
+        // Sum of the max scores of the skipped terms
+        double remaining_score = 0.0;
+    };
+
+    // Documents tied within MIN are ordered by rating and id, so pruning
+    // keeps those close to the threshold
+    inline static constexpr double PRUNING_MARGIN = 2 * MIN;
+
+    inline static constexpr size_t PRUNING_SAMPLE_SIZE = 4096;
+
+    // Scores the postings of the terms with ordinals in [ordinal_begin, ordinal_end)
+    // by add(ordinal, score). MaxScore pruning scores the terms in descending
+    // order of their max scores; once the remaining ones add up to less than
+    // the capacity-th best partial score, documents not scored yet cannot
+    // reach the top documents and the remaining terms are skipped.
+    template <typename OrdinalPredicate, typename AddFunc>
+    PruningResult ScorePlusTerms(const std::pmr::vector<ScoredTerm>& terms, int ordinal_begin, int ordinal_end, int capacity,
+        OrdinalPredicate& ordinal_predicate, const ScoreAccumulator& accumulator, AddFunc add) const;
+
+    // capacity-th best score of the documents, minus infinity if there are fewer
+    static double FindThresholdScore(const std::pmr::vector<int>& ordinals, const ScoreAccumulator& accumulator, int capacity,
+        std::pmr::vector<double>& heap);
+
+    // Pushes a document scored by ScorePlusTerms, rescoring it if needed
+    void PushScoredDocument(int ordinal, double score, const PruningResult& pruning,
+        const std::pmr::vector<ScoredTerm>& terms, TopDocuments& top_documents) const;
+
+    // Relevance summed in the order of the terms, as exhaustive scoring sums it
+    double ComputeRelevance(const std::pmr::vector<ScoredTerm>& terms, int ordinal) const;
+
+    inline static constexpr int SHARDS_PER_THREAD = 4;
+
+    inline static constexpr int MIN_SHARD_SIZE = 4096;
+
+    inline static constexpr size_t BUFFER_POSTING_LIMIT = size_t{ 1 } << 18;
+
+    // Number of segments of one size tier that are merged together
+    inline static constexpr size_t MERGE_FACTOR = 4;
+
+    // Size tier of a segment: segments of tier k have fewer than
+    // BUFFER_POSTING_LIMIT * MERGE_FACTOR^(k + 1) postings
+    static int GetSegmentTier(size_t posting_count);
+
+    // Merges the newest segments while MERGE_FACTOR of them share a tier
+    void MergeSegments();
+
+    // Calls func(ordinals, counts) for the postings of the term with
+    // ordinals in [ordinal_begin, ordinal_end), segment after segment and
+    // then the buffer, so the ordinals come in ascending order
+    template <typename Func>
+    void ForEachPostingBlock(int term_id, int ordinal_begin, int ordinal_end, Func func) const;
+
+    // Same for the postings of one segment, decoded block by block
+    template <typename Func>
+    static void ForEachSegmentBlock(const IndexSegment& segment, int term_id, int ordinal_begin, int ordinal_end, Func func);
+
+    // Passes func the part of a block of postings with ordinals in [ordinal_begin, ordinal_end)
+    template <typename Func>
+    static void VisitPostingBlock(ArrayView<int> ordinals, ArrayView<uint32_t> counts,
+        int ordinal_begin, int ordinal_end, Func& func);
+
+    // Number of ordinals scored by one task of a parallel query
+    int ComputeShardSize(int ordinal_bound) const;
+
+    // Index of a run of documents from a bulk load, with its own term numbering
+    struct PartialIndex {
+        std::vector<std::string_view> words;
+        // Postings of every local term as (position in the batch, occurrence count)
+        std::vector<std::vector<std::pair<int, uint32_t>>> postings;
+        // Terms of the run's documents, document after document, with local
+        // term ids until the run is merged
+        std::vector<ForwardIndex::Entry> document_terms;
+        std::vector<size_t> document_offsets;
+        std::vector<double> inverse_word_counts;
+        std::vector<DocumentFingerprint> fingerprints;
+    };
+
+    void BuildPartialIndex(const std::vector<NewDocument>& documents, size_t begin, size_t end, PartialIndex& index) const;
+
+    // ordinal_predicate(ordinal) tells whether the document takes part
+    template <typename OrdinalPredicate>
+    void FindAllDocuments(std::execution::sequenced_policy policy, const Query& query,
+        OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const;
+
+    template <typename OrdinalPredicate>
+    void FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
+        OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const;
+
+    template <typename OrdinalPredicate>
+    void FindAllDocuments(const Query& query,
+        OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const;
 }; 
 
+class SearchServer::PreparedQuery {
+private:
+    friend class SearchServer;
+
+    // Query words point into the text, which is shared between copies
+    std::shared_ptr<const std::string> text_;
+    Query query_;
+};
+
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words) {
     if (any_of(stop_words.begin(), stop_words.end(), [](auto& word) {return !IsValidWord(word); })) {
         throw std::invalid_argument("Invalid characters in stop words.");
     }
-    std::set<std::string_view> stop_wordss = MakeUniqueNonEmptyStrings(stop_words);
-    for (auto& word : stop_wordss) {
-        stop_words_.insert(std::string{ word });
+    stop_words_ = StopWordSet(stop_words);
+}
+
+template <size_t WordCount>
+SearchServer::SearchServer(const StaticStopWords<WordCount>& stop_words) {
+    if (any_of(stop_words.begin(), stop_words.end(), [](std::string_view word) {return !IsValidWord(word); })) {
+        throw std::invalid_argument("Invalid characters in stop words.");
     }
+    stop_words_ = StopWordSet(stop_words);
+}
+
+inline bool SearchServer::IsRemoved(int ordinal) const {
+    return removed_ordinals_[ordinal / 64] >> (ordinal % 64) & 1;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+auto SearchServer::MakeOrdinalPredicate(DocumentPredicate& document_predicate) const {
+    return [this, &document_predicate](int ordinal) {
+        return !IsRemoved(ordinal) && document_predicate(documents_index_[ordinal], statuses_[ordinal], ratings_[ordinal]);
+    };
+}
+
+inline auto SearchServer::MakeBitsetPredicate(const uint64_t* bitset) {
+    return [bitset](int ordinal) {
+        return (bitset[ordinal / 64] >> (ordinal % 64) & 1) != 0;
+    };
+}
+
+inline double SearchServer::TopDocuments::GetMinRelevance() const {
+    return capacity_ > 0 && size_ == capacity_ ? heap_[0].relevance : -std::numeric_limits<double>::infinity();
+}
+
+inline void SearchServer::PushScoredDocument(int ordinal, double score, const PruningResult& pruning,
+    const std::pmr::vector<ScoredTerm>& terms, TopDocuments& top_documents) const {
+    if (!pruning.rescore) {
+        top_documents.Push({ documents_index_[ordinal], score, ratings_[ordinal] });
+    }
+    // Push would reject a document this far below the least relevant kept one
+    else if (score >= pruning.min_partial_score
+        && score + pruning.remaining_score >= top_documents.GetMinRelevance() - PRUNING_MARGIN) {
+        top_documents.Push({ documents_index_[ordinal], ComputeRelevance(terms, ordinal), ratings_[ordinal] });
+    }
+}
+
+template <typename Func>
+void SearchServer::VisitPostingBlock(ArrayView<int> ordinals, ArrayView<uint32_t> counts,
+    int ordinal_begin, int ordinal_end, Func& func) {
+    if (ordinals.empty()) {
+        return;
+    }
+    size_t first = 0;
+    size_t last = ordinals.size();
+    if (ordinals[0] < ordinal_begin) {
+        first = std::lower_bound(ordinals.begin(), ordinals.end(), ordinal_begin) - ordinals.begin();
+    }
+    if (ordinals[last - 1] >= ordinal_end) {
+        last = std::lower_bound(ordinals.begin() + first, ordinals.end(), ordinal_end) - ordinals.begin();
+    }
+    if (first < last) {
+        func(ordinals.subview(first, last - first), counts.subview(first, last - first));
+    }
+}
+
+template <typename Func>
+void SearchServer::ForEachSegmentBlock(const IndexSegment& segment, int term_id, int ordinal_begin, int ordinal_end, Func func) {
+    if (segment.GetOrdinalEnd() <= ordinal_begin || segment.GetOrdinalBegin() >= ordinal_end) {
+        return;
+    }
+    const ArrayView<IndexSegment::PostingBlock> blocks = segment.GetBlocks(term_id);
+    int ordinals[IndexSegment::BLOCK_SIZE];
+    uint32_t counts[IndexSegment::BLOCK_SIZE];
+    auto block = std::partition_point(blocks.begin(), blocks.end(), [ordinal_begin](const IndexSegment::PostingBlock& block) {
+        return block.last_ordinal < ordinal_begin;
+    });
+    for (; block != blocks.end() && block->first_ordinal < ordinal_end; ++block) {
+        segment.DecodeBlock(*block, ordinals, counts);
+        VisitPostingBlock({ ordinals, block->posting_count }, { counts, block->posting_count }, ordinal_begin, ordinal_end, func);
+    }
+}
+
+template <typename Func>
+void SearchServer::ForEachPostingBlock(int term_id, int ordinal_begin, int ordinal_end, Func func) const {
+    for (const std::shared_ptr<const IndexSegment>& segment : segments_) {
+        ForEachSegmentBlock(*segment, term_id, ordinal_begin, ordinal_end, func);
+    }
+    if (term_id < static_cast<int>(buffer_postings_.size()) && buffer_ordinal_begin_ < ordinal_end) {
+        const PostingList& postings = buffer_postings_[term_id];
+        VisitPostingBlock(postings.GetOrdinals(), postings.GetCounts(), ordinal_begin, ordinal_end, func);
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+    int max_result_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_result_count);
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query, false);    
-        auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-        sort(std::execution::par, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MIN) {
-                return lhs.rating > rhs.rating;
-            }
-        return lhs.relevance > rhs.relevance; });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-        return matched_documents;
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+    int max_result_count) const {
+    const ParsedQuery query(*this, raw_query, false);
+    TopDocuments top_documents(max_result_count);
+    FindAllDocuments(policy, *query, MakeOrdinalPredicate(document_predicate), top_documents);
+    return top_documents.Extract();
 }
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status; });
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status,
+    int max_result_count) const {
+    const ParsedQuery query(*this, raw_query, false);
+    return FindTopDocumentsByFilter(policy, *query, DocumentFilter::ByStatus(status), max_result_count);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter,
+    int max_result_count) const {
+    const ParsedQuery query(*this, raw_query, false);
+    return FindTopDocumentsByFilter(policy, *query, filter, max_result_count);
 }
 
 template <typename ExecutionPolicy>
@@ -166,78 +651,212 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& poli
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+    int max_result_count) const {
+    TopDocuments top_documents(max_result_count);
+    FindAllDocuments(policy, query.query_, MakeOrdinalPredicate(document_predicate), top_documents);
+    return top_documents.Extract();
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status,
+    int max_result_count) const {
+    return FindTopDocumentsByFilter(policy, query.query_, DocumentFilter::ByStatus(status), max_result_count);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, const DocumentFilter& filter,
+    int max_result_count) const {
+    return FindTopDocumentsByFilter(policy, query.query_, filter, max_result_count);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsByFilter(const ExecutionPolicy& policy, const Query& query, const DocumentFilter& filter,
+    int max_result_count) const {
+    std::string cache_key;
+    std::vector<Document> result;
+    if (result_cache_) {
+        cache_key = MakeResultCacheKey(query, filter, max_result_count);
+        if (result_cache_->Find(cache_key, result)) {
+            return result;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+    }
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    std::pmr::vector<uint64_t> mask(&arena);
+    TopDocuments top_documents(max_result_count);
+    FindAllDocuments(policy, query, MakeBitsetPredicate(GetFilterBitset(filter, mask)), top_documents);
+    result = top_documents.Extract();
+    if (result_cache_) {
+        result_cache_->Insert(std::move(cache_key), result);
+    }
+    return result;
+}
+
+template <typename OrdinalPredicate, typename AddFunc>
+SearchServer::PruningResult SearchServer::ScorePlusTerms(const std::pmr::vector<ScoredTerm>& terms, int ordinal_begin, int ordinal_end, int capacity,
+    OrdinalPredicate& ordinal_predicate, const ScoreAccumulator& accumulator, AddFunc add) const {
+    // Partial scores bound the relevances from below only if no term lowers them
+    const bool can_prune = capacity > 0 && terms.size() > 1 && std::all_of(terms.begin(), terms.end(), [](const ScoredTerm& term) {
+        return term.inverse_document_freq >= 0.0;
+    });
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    // Documents the first terms reach: the capacity-th best of their partial
+    // scores bounds the threshold from below at the cost of a short scan
+    std::pmr::vector<int> sample(&arena);
+    auto score_term = [&](const ScoredTerm& term, auto is_sampled) {
+        ForEachPostingBlock(term.term_id, ordinal_begin, ordinal_end, [&](ArrayView<int> ordinals, ArrayView<uint32_t> counts) {
+            for (size_t i = 0; i < ordinals.size(); ++i) {
+                const int ordinal = ordinals[i];
+                if (!accumulator.IsExcluded(ordinal) && ordinal_predicate(ordinal)) {
+                    if (is_sampled && sample.size() < PRUNING_SAMPLE_SIZE && accumulator.GetScore(ordinal) == 0.0) {
+                        sample.push_back(ordinal);
+                    }
+                    add(ordinal, counts[i] * inverse_word_counts_[ordinal] * term.inverse_document_freq);
+                }
             }
+        });
+    };
+    if (!can_prune) {
+        for (const ScoredTerm& term : terms) {
+            score_term(term, std::false_type{});
         }
+        return {};
     }
 
+    sample.reserve(PRUNING_SAMPLE_SIZE);
+    std::pmr::vector<const ScoredTerm*> order(&arena);
+    order.reserve(terms.size());
+    for (const ScoredTerm& term : terms) {
+        order.push_back(&term);
+    }
+    std::sort(order.begin(), order.end(), [](const ScoredTerm* lhs, const ScoredTerm* rhs) {
+        return lhs->max_score > rhs->max_score;
+    });
+    // Sums of the max scores of the terms from the i-th on
+    std::pmr::vector<double> remaining_scores(order.size() + 1, 0.0, &arena);
+    for (size_t i = order.size(); i-- > 0;) {
+        remaining_scores[i] = remaining_scores[i + 1] + order[i]->max_score;
+    }
+    std::pmr::vector<double> heap(&arena);
+    heap.reserve(std::min(static_cast<size_t>(capacity), PRUNING_SAMPLE_SIZE));
+    // Bound of the threshold: a term raises it by its max score at most
+    double max_threshold = 0.0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i > 0 && remaining_scores[i] < max_threshold - PRUNING_MARGIN) {
+            const double threshold = FindThresholdScore(sample, accumulator, capacity, heap);
+            if (remaining_scores[i] < threshold - PRUNING_MARGIN) {
+                return { true, threshold - PRUNING_MARGIN - remaining_scores[i], remaining_scores[i] };
+            }
+        }
+        // A positive contribution tells a document scored before from a new one
+        if (order[i]->inverse_document_freq > 0.0) {
+            score_term(*order[i], std::true_type{});
+        } else {
+            score_term(*order[i], std::false_type{});
+        }
+        max_threshold += order[i]->max_score;
+    }
+    return { true, -std::numeric_limits<double>::infinity(), 0.0 };
+}
+
+template <typename OrdinalPredicate>
+void SearchServer::FindAllDocuments(std::execution::sequenced_policy policy, const Query& query,
+    OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const {
+    ScoreAccumulator& accumulator = GetScoreAccumulator();
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
     for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const int term_id = dictionary_.Find(word);
+        if (term_id == TermDictionary::NO_TERM) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+        ForEachPostingBlock(term_id, 0, ordinal_bound, [&accumulator](ArrayView<int> ordinals, ArrayView<uint32_t>) {
+            for (const int ordinal : ordinals) {
+                accumulator.Exclude(ordinal);
+            }
+        });
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    const std::pmr::vector<ScoredTerm> plus_terms = FindScoredTerms(query.plus_words, &arena);
+    const PruningResult pruning = ScorePlusTerms(plus_terms, 0, ordinal_bound, top_documents.GetCapacity(), ordinal_predicate, accumulator,
+        [&accumulator](int ordinal, double score) {
+            accumulator.Add(ordinal, score);
+        });
+
+    for (const int ordinal : accumulator.GetTouched()) {
+        PushScoredDocument(ordinal, accumulator.GetScore(ordinal), pruning, plus_terms, top_documents);
     }
-    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(100);
-    for_each(std::execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        [this, document_predicate, &document_to_relevance](std::string_view word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
+template <typename OrdinalPredicate>
+void SearchServer::FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
+    OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const {
+    // Every shard scores its own range of ordinals and keeps its own top
+    // documents, so shards share nothing but the read-only index. Scratch
+    // memory comes from the calling thread's arena. Shards score all the
+    // plus words: MaxScore pruning would fill every shard's top documents
+    // by rescoring, which costs more than the skipped postings.
+    ScratchArena& arena = ScratchArena::GetThreadArena();
+    const ScratchArena::Scope scope(arena);
+    const std::pmr::vector<int> minus_term_ids = FindTermIds(query.minus_words, &arena);
+    const std::pmr::vector<int> plus_term_ids = FindTermIds(query.plus_words, &arena);
+    std::pmr::vector<double> inverse_document_freqs(&arena);
+    inverse_document_freqs.reserve(plus_term_ids.size());
+    for (const int term_id : plus_term_ids) {
+        inverse_document_freqs.push_back(ComputeWordInverseDocumentFreq(term_id));
+    }
+
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
+    const int shard_size = ComputeShardSize(ordinal_bound);
+    const size_t shard_count = (ordinal_bound + shard_size - 1) / shard_size;
+    const size_t shard_capacity = top_documents.GetCapacity();
+    std::pmr::vector<Document> shard_documents(shard_count * shard_capacity, &arena);
+    std::pmr::vector<int> shard_document_counts(shard_count, &arena);
+    ScoreAccumulator& accumulator = GetScoreAccumulator();
+    accumulator.BeginShards();
+    thread_pool_->ParallelFor(shard_count, [&](size_t shard) {
+        const int begin = static_cast<int>(shard) * shard_size;
+        const int end = std::min(begin + shard_size, ordinal_bound);
+        for (const int term_id : minus_term_ids) {
+            ForEachPostingBlock(term_id, begin, end, [&accumulator](ArrayView<int> ordinals, ArrayView<uint32_t>) {
+                for (const int ordinal : ordinals) {
+                    accumulator.ExcludeInShard(ordinal);
                 }
-            }
-        });
-    
-    for_each(std::execution::par,
-        query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance](std::string_view word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                    document_to_relevance.Erase(document_id);
+            });
+        }
+        for (size_t term = 0; term < plus_term_ids.size(); ++term) {
+            const double inverse_document_freq = inverse_document_freqs[term];
+            ForEachPostingBlock(plus_term_ids[term], begin, end, [&](ArrayView<int> ordinals, ArrayView<uint32_t> counts) {
+                for (size_t i = 0; i < ordinals.size(); ++i) {
+                    const int ordinal = ordinals[i];
+                    if (!accumulator.IsExcluded(ordinal) && ordinal_predicate(ordinal)) {
+                        accumulator.AddInShard(ordinal, counts[i] * inverse_word_counts_[ordinal] * inverse_document_freq);
+                    }
                 }
-            }
+            });
+        }
+        TopDocuments shard_top(shard_documents.data() + shard * shard_capacity, static_cast<int>(shard_capacity));
+        accumulator.DrainShard(begin, end, [this, &shard_top](int ordinal, double relevance) {
+            shard_top.Push({ documents_index_[ordinal], relevance, ratings_[ordinal] });
         });
-    std::map<int, double> all_document_to_relevance = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : all_document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+        shard_document_counts[shard] = shard_top.Finish();
+    });
+    accumulator.EndShards();
+
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        const Document* documents = shard_documents.data() + shard * shard_capacity;
+        for (int i = 0; i < shard_document_counts[shard]; ++i) {
+            top_documents.Push(documents[i]);
+        }
     }
-    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-    DocumentPredicate document_predicate) const {
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
+template <typename OrdinalPredicate>
+void SearchServer::FindAllDocuments(const Query& query,
+    OrdinalPredicate ordinal_predicate, TopDocuments& top_documents) const {
+    FindAllDocuments(std::execution::seq, query, ordinal_predicate, top_documents);
 }
\ No newline at end of file
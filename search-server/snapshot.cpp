@@ -0,0 +1,430 @@
+#include "search_server.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+using namespace std;
+
+// Snapshot layout, native byte order, every section padded to 8 bytes:
+//   header
+//   stop words: count, then (length, bytes) for each
+//   documents: ordinal bound, document id, inverse word count and
+//              fingerprint of every ordinal, count, then (id, rating, status,
+//              ordinal) for each live document, forward index offsets of
+//              every ordinal, entry count and the (term id, count) entries
+//   terms: id bound, the word of every id, empty for free ids, then the
+//          document frequency and max term frequency of every id
+//   postings of all terms as one segment: term blocks, block count and
+//   blocks, data size and encoded data
+// Removed documents are left out of the postings and the forward index;
+// their ordinals are the ones no document record refers to.
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'S', 'R', 'V', 'S', 'N', 'A', 'P' };
+constexpr uint32_t SNAPSHOT_VERSION = 6;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+struct DocumentRecord {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    int32_t ordinal;
+};
+
+uint64_t MixChecksum(uint64_t checksum, const char* word) {
+    uint64_t value;
+    memcpy(&value, word, sizeof(value));
+    return (checksum ^ value) * 0x100000001b3ULL;
+}
+
+constexpr uint64_t CHECKSUM_SEED = 0xcbf29ce484222325ULL;
+
+uint64_t ComputeChecksum(const char* data, size_t size) {
+    uint64_t checksum = CHECKSUM_SEED;
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        checksum = MixChecksum(checksum, data + i);
+    }
+    return checksum;
+}
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(ofstream& output)
+        : output_(output) {
+    }
+
+    void Write(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        output_.write(bytes, size);
+        size_ += size;
+        size_t i = 0;
+        while (i < size && carry_size_ > 0) {
+            AddByte(bytes[i++]);
+        }
+        for (; i + 8 <= size; i += 8) {
+            checksum_ = MixChecksum(checksum_, bytes + i);
+        }
+        while (i < size) {
+            AddByte(bytes[i++]);
+        }
+    }
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        Write(&value, sizeof(value));
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t count) {
+        Write(data, sizeof(T) * count);
+        Align();
+    }
+
+    void WriteString(string_view text) {
+        WriteValue<uint64_t>(text.size());
+        WriteArray(text.data(), text.size());
+    }
+
+    void Align() {
+        static const char zeros[8] = {};
+        Write(zeros, (8 - size_ % 8) % 8);
+    }
+
+    uint64_t GetSize() const {
+        return size_;
+    }
+
+    uint64_t GetChecksum() const {
+        return checksum_;
+    }
+
+private:
+    ofstream& output_;
+    uint64_t size_ = 0;
+    uint64_t checksum_ = CHECKSUM_SEED;
+    char carry_[8] = {};
+    size_t carry_size_ = 0;
+
+    void AddByte(char byte) {
+        carry_[carry_size_++] = byte;
+        if (carry_size_ == 8) {
+            checksum_ = MixChecksum(checksum_, carry_);
+            carry_size_ = 0;
+        }
+    }
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    template <typename T>
+    T ReadValue() {
+        T value;
+        memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // Reads the element count of a section before it is allocated for, so a
+    // corrupt count cannot exceed the bytes left
+    size_t ReadCount(size_t min_element_size) {
+        const uint64_t count = ReadValue<uint64_t>();
+        if (count > (size_ - pos_) / min_element_size) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+        return static_cast<size_t>(count);
+    }
+
+    // Views point into the snapshot, which keeps every section 8-byte aligned
+    template <typename T>
+    ArrayView<T> ReadArray(size_t count) {
+        if (count > (size_ - pos_) / sizeof(T)) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+        const T* data = reinterpret_cast<const T*>(Take(sizeof(T) * count));
+        Take((8 - pos_ % 8) % 8);
+        return { data, count };
+    }
+
+    string_view ReadString() {
+        const size_t length = ReadValue<uint64_t>();
+        const ArrayView<char> text = ReadArray<char>(length);
+        return { text.data(), text.size() };
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+
+    const char* Take(size_t size) {
+        if (size > size_ - pos_) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+        const char* result = data_ + pos_;
+        pos_ += size;
+        return result;
+    }
+};
+
+}  // namespace
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    // Servers loaded from the file keep reading the old one through their
+    // mappings, so the new file replaces it by name only
+    const string temp_path = path + ".tmp"s;
+    ofstream output(temp_path, ios::binary | ios::trunc);
+    if (!output) {
+        throw runtime_error("Не удалось создать файл "s + temp_path);
+    }
+    SnapshotHeader header{};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    SnapshotWriter writer(output);
+    writer.WriteValue<uint64_t>(stop_words_.size());
+    for (const string& word : stop_words_) {
+        writer.WriteString(word);
+    }
+
+    writer.WriteValue<uint64_t>(documents_index_.size());
+    writer.WriteArray(documents_index_.data(), documents_index_.size());
+    writer.WriteArray(inverse_word_counts_.data(), inverse_word_counts_.size());
+    writer.WriteArray(fingerprints_.data(), fingerprints_.size());
+    writer.WriteValue<uint64_t>(documents_id_.size());
+    for (const int document_id : documents_id_) {
+        const int ordinal = GetOrdinal(document_id);
+        writer.WriteValue(DocumentRecord{ document_id, ratings_[ordinal], static_cast<int32_t>(statuses_[ordinal]), ordinal });
+    }
+    vector<uint64_t> forward_offsets = { 0 };
+    forward_offsets.reserve(documents_index_.size() + 1);
+    for (int ordinal = 0; ordinal < static_cast<int>(documents_index_.size()); ++ordinal) {
+        forward_offsets.push_back(forward_offsets.back() + (IsRemoved(ordinal) ? 0 : forward_index_.Get(ordinal).size()));
+    }
+    writer.WriteArray(forward_offsets.data(), forward_offsets.size());
+    writer.WriteValue<uint64_t>(forward_offsets.back());
+    for (int ordinal = 0; ordinal < static_cast<int>(documents_index_.size()); ++ordinal) {
+        if (!IsRemoved(ordinal)) {
+            const ArrayView<ForwardIndex::Entry> entries = forward_index_.Get(ordinal);
+            writer.Write(entries.data(), sizeof(ForwardIndex::Entry) * entries.size());
+        }
+    }
+    writer.Align();
+
+    // Saved exact, while max_term_freqs_ may be left too high by removals
+    const int term_id_bound = dictionary_.GetIdBound();
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
+    vector<int32_t> document_freqs(term_id_bound, 0);
+    vector<double> max_term_freqs(term_id_bound, 0.0);
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        if (!IsRemoved(ordinal)) {
+            for (const auto& [term_id, count] : forward_index_.Get(ordinal)) {
+                ++document_freqs[term_id];
+                max_term_freqs[term_id] = max(max_term_freqs[term_id], count * inverse_word_counts_[ordinal]);
+            }
+        }
+    }
+    writer.WriteValue<uint64_t>(term_id_bound);
+    for (int term_id = 0; term_id < term_id_bound; ++term_id) {
+        writer.WriteString(document_freqs[term_id] > 0 ? dictionary_.GetWord(term_id) : string_view{});
+    }
+    writer.WriteArray(document_freqs.data(), document_freqs.size());
+    writer.WriteArray(max_term_freqs.data(), max_term_freqs.size());
+    const shared_ptr<const IndexSegment> segment = IndexSegment::Build(0, ordinal_bound, term_id_bound,
+        [this, ordinal_bound](int term_id, auto func) {
+            ForEachPostingBlock(term_id, 0, ordinal_bound, func);
+        },
+        [this](int ordinal) {
+            return IsRemoved(ordinal) ? -1 : ordinal;
+        }, *thread_pool_);
+    const ArrayView<uint64_t> term_blocks = segment->GetTermBlocks();
+    const ArrayView<IndexSegment::PostingBlock> blocks = segment->GetAllBlocks();
+    const ArrayView<uint8_t> data = segment->GetData();
+    writer.WriteArray(term_blocks.data(), term_blocks.size());
+    writer.WriteValue<uint64_t>(blocks.size());
+    writer.WriteArray(blocks.data(), blocks.size());
+    writer.WriteValue<uint64_t>(data.size());
+    writer.WriteArray(data.data(), data.size());
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.payload_size = writer.GetSize();
+    header.checksum = writer.GetChecksum();
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    error_code error;
+    if (output) {
+        filesystem::rename(temp_path, path, error);
+    }
+    if (!output || error) {
+        filesystem::remove(temp_path, error);
+        throw runtime_error("Не удалось записать файл "s + path);
+    }
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path, bool verify) {
+    auto snapshot = make_shared<const MappedFile>(path);
+    SnapshotHeader header;
+    if (snapshot->size() < sizeof(header)) {
+        throw runtime_error("Файл "s + path + " не является снимком"s);
+    }
+    memcpy(&header, snapshot->data(), sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw runtime_error("Файл "s + path + " не является снимком"s);
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byte_order != BYTE_ORDER_MARK) {
+        throw runtime_error("Неподдерживаемая версия снимка"s);
+    }
+    const char* payload = snapshot->data() + sizeof(header);
+    if (header.payload_size != snapshot->size() - sizeof(header)
+        || (verify && ComputeChecksum(payload, header.payload_size) != header.checksum)) {
+        throw runtime_error("Снимок поврежден"s);
+    }
+
+    SearchServer server;
+    SnapshotReader reader(payload, header.payload_size);
+    vector<string_view> stop_words(reader.ReadCount(sizeof(uint64_t)));
+    for (string_view& word : stop_words) {
+        word = reader.ReadString();
+    }
+    server.stop_words_ = StopWordSet(stop_words);
+
+    const ArrayView<int> documents_index = reader.ReadArray<int>(reader.ReadValue<uint64_t>());
+    server.documents_index_.assign(documents_index.begin(), documents_index.end());
+    const ArrayView<double> inverse_word_counts = reader.ReadArray<double>(documents_index.size());
+    server.inverse_word_counts_.assign(inverse_word_counts.begin(), inverse_word_counts.end());
+    const ArrayView<DocumentFingerprint> fingerprints = reader.ReadArray<DocumentFingerprint>(documents_index.size());
+    server.fingerprints_.assign(fingerprints.begin(), fingerprints.end());
+    server.ResizeOrdinalBitsets();
+    const int ordinal_bound = static_cast<int>(documents_index.size());
+    server.ratings_.resize(ordinal_bound);
+    server.statuses_.resize(ordinal_bound);
+    vector<bool> is_live(ordinal_bound, false);
+    const ArrayView<DocumentRecord> documents = reader.ReadArray<DocumentRecord>(reader.ReadValue<uint64_t>());
+    server.ordinals_.reserve(documents.size());
+    server.fingerprint_counts_.reserve(documents.size());
+    for (const DocumentRecord& document : documents) {
+        if (document.ordinal < 0 || document.ordinal >= ordinal_bound || is_live[document.ordinal]
+            || !IsValidStatus(static_cast<DocumentStatus>(document.status))
+            || documents_index[document.ordinal] != document.id || !server.ordinals_.emplace(document.id, document.ordinal).second) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+        is_live[document.ordinal] = true;
+        server.ratings_[document.ordinal] = document.rating;
+        server.statuses_[document.ordinal] = static_cast<DocumentStatus>(document.status);
+        server.status_ordinals_[document.status][document.ordinal / 64] |= uint64_t{ 1 } << (document.ordinal % 64);
+        server.documents_id_.emplace_hint(server.documents_id_.end(), document.id);
+        ++server.fingerprint_counts_[fingerprints[document.ordinal]];
+    }
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        if (!is_live[ordinal]) {
+            server.removed_ordinals_[ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+        }
+    }
+    const ArrayView<uint64_t> forward_offsets = reader.ReadArray<uint64_t>(ordinal_bound + 1);
+    const ArrayView<ForwardIndex::Entry> forward_entries = reader.ReadArray<ForwardIndex::Entry>(reader.ReadValue<uint64_t>());
+    if (forward_offsets[0] != 0 || forward_offsets[ordinal_bound] != forward_entries.size()) {
+        throw runtime_error("Снимок поврежден"s);
+    }
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        if (forward_offsets[ordinal] > forward_offsets[ordinal + 1] || forward_offsets[ordinal + 1] > forward_entries.size()
+            || (!is_live[ordinal] && forward_offsets[ordinal] != forward_offsets[ordinal + 1])) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+    }
+
+    // Each term has a string length, a document freq, a max term freq and a
+    // block offset
+    const size_t term_id_bound = reader.ReadCount(sizeof(uint64_t) + sizeof(int32_t) + sizeof(double) + sizeof(uint64_t));
+    vector<string_view> words(term_id_bound);
+    for (string_view& word : words) {
+        word = reader.ReadString();
+    }
+    const ArrayView<int32_t> document_freqs = reader.ReadArray<int32_t>(term_id_bound);
+    const ArrayView<double> max_term_freqs = reader.ReadArray<double>(term_id_bound);
+    const ArrayView<uint64_t> term_blocks = reader.ReadArray<uint64_t>(term_id_bound + 1);
+    const ArrayView<IndexSegment::PostingBlock> blocks = reader.ReadArray<IndexSegment::PostingBlock>(reader.ReadValue<uint64_t>());
+    const ArrayView<uint8_t> data = reader.ReadArray<uint8_t>(reader.ReadValue<uint64_t>());
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        int previous_term_id = -1;
+        for (uint64_t i = forward_offsets[ordinal]; i < forward_offsets[ordinal + 1]; ++i) {
+            const int term_id = forward_entries[i].term_id;
+            if (term_id <= previous_term_id || static_cast<size_t>(term_id) >= term_id_bound) {
+                throw runtime_error("Снимок поврежден"s);
+            }
+            previous_term_id = term_id;
+        }
+    }
+    for (size_t term_id = 0; term_id < term_id_bound; ++term_id) {
+        if (document_freqs[term_id] < 0 || words[term_id].empty() != (document_freqs[term_id] == 0)) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+        server.dictionary_.AppendTerm(words[term_id], document_freqs[term_id]);
+        server.UpdateDocumentFreq(static_cast<int>(term_id));
+    }
+    server.max_term_freqs_.assign(max_term_freqs.begin(), max_term_freqs.end());
+    server.forward_index_ = ForwardIndex(forward_entries, forward_offsets, snapshot);
+    auto segment = make_shared<const IndexSegment>(0, ordinal_bound, term_blocks, blocks, data, move(snapshot));
+    if (!segment->CheckLayout()) {
+        throw runtime_error("Снимок поврежден"s);
+    }
+    if (verify) {
+        server.VerifySnapshotIndex(*segment, is_live);
+    }
+    if (segment->GetPostingCount() > 0) {
+        server.segments_.push_back(move(segment));
+    }
+    server.buffer_ordinal_begin_ = ordinal_bound;
+    server.RefreshIdfDocumentCount();
+    return server;
+}
+
+void SearchServer::VerifySnapshotIndex(const IndexSegment& segment, const vector<bool>& is_live) const {
+    // Derived data must match the forward index, and the postings must
+    // invert it
+    const int ordinal_bound = static_cast<int>(documents_index_.size());
+    const int term_id_bound = dictionary_.GetIdBound();
+    vector<int> document_freqs(term_id_bound, 0);
+    vector<double> max_term_freqs(term_id_bound, 0.0);
+    for (int ordinal = 0; ordinal < ordinal_bound; ++ordinal) {
+        DocumentFingerprint fingerprint;
+        for (const auto& [term_id, count] : forward_index_.Get(ordinal)) {
+            ++document_freqs[term_id];
+            max_term_freqs[term_id] = max(max_term_freqs[term_id], count * inverse_word_counts_[ordinal]);
+            fingerprint.AddWord(dictionary_.GetWord(term_id));
+        }
+        if (is_live[ordinal] && fingerprint != fingerprints_[ordinal]) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+    }
+    if (max_term_freqs != max_term_freqs_) {
+        throw runtime_error("Снимок поврежден"s);
+    }
+    for (int term_id = 0; term_id < term_id_bound; ++term_id) {
+        int posting_count = 0;
+        ForEachSegmentBlock(segment, term_id, 0, ordinal_bound, [&](ArrayView<int> ordinals, ArrayView<uint32_t>) {
+            for (const int ordinal : ordinals) {
+                if (!is_live[ordinal]) {
+                    throw runtime_error("Снимок поврежден"s);
+                }
+                ++posting_count;
+            }
+            });
+        if (posting_count != document_freqs[term_id] || posting_count != dictionary_.GetRefCount(term_id)) {
+            throw runtime_error("Снимок поврежден"s);
+        }
+    }
+}
@@ -0,0 +1,10 @@
+#include "stop_word_set.h"
+using namespace std;
+
+void StopWordSet::Build() {
+    slots_.assign(GetCapacity(words_.size()), Slot{});
+    for (size_t i = 0; i < words_.size(); ++i) {
+        Insert(slots_.data(), slots_.size(), static_cast<uint32_t>(i), Hash(words_[i]));
+        filter_.Add(words_[i]);
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "string_processing.h"
+
+template <size_t WordCount>
+class StaticStopWords;
+
+// Stop words in an open-addressing hash table. A bitmap of the word lengths
+// and first bytes rejects most other words before they are hashed.
+class StopWordSet {
+public:
+    struct Slot {
+        // Index of the word plus one, zero in an empty slot
+        uint32_t word = 0;
+        // High half of the word's hash, compared before the word itself
+        uint32_t tag = 0;
+    };
+
+    struct Filter {
+        // Bit per word length, the last one shared by the longer words
+        uint64_t lengths = 0;
+        uint64_t first_bytes[4] = { 0, 0, 0, 0 };
+
+        constexpr void Add(std::string_view word) {
+            lengths |= GetLengthBit(word);
+            const unsigned char first = static_cast<unsigned char>(word[0]);
+            first_bytes[first / 64] |= uint64_t{ 1 } << (first % 64);
+        }
+
+        constexpr bool MayContain(std::string_view word) const {
+            if ((lengths & GetLengthBit(word)) == 0 || word.empty()) {
+                return false;
+            }
+            const unsigned char first = static_cast<unsigned char>(word[0]);
+            return (first_bytes[first / 64] >> (first % 64) & 1) != 0;
+        }
+
+        static constexpr uint64_t GetLengthBit(std::string_view word) {
+            return uint64_t{ 1 } << (word.size() < 63 ? word.size() : 63);
+        }
+    };
+
+    // FNV-1a
+    static constexpr uint64_t Hash(std::string_view word) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const char c : word) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Power of two with at least two slots per word
+    static constexpr size_t GetCapacity(size_t word_count) {
+        size_t capacity = 1;
+        while (capacity < word_count * 2) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // Adds the word_index-th word to the table, which must not contain it
+    static constexpr void Insert(Slot* slots, size_t capacity, uint32_t word_index, uint64_t hash) {
+        size_t position = hash & (capacity - 1);
+        while (slots[position].word != 0) {
+            position = (position + 1) & (capacity - 1);
+        }
+        slots[position] = { word_index + 1, static_cast<uint32_t>(hash >> 32) };
+    }
+
+    template <typename Words>
+    static constexpr bool Find(const Slot* slots, size_t capacity, const Words& words, std::string_view word) {
+        const uint64_t hash = Hash(word);
+        const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        for (size_t position = hash & (capacity - 1); slots[position].word != 0; position = (position + 1) & (capacity - 1)) {
+            if (slots[position].tag == tag && words[slots[position].word - 1] == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    StopWordSet() = default;
+
+    // Empty and repeated words are skipped
+    template <typename StringContainer>
+    explicit StopWordSet(const StringContainer& words);
+
+    // Takes over the table the compiler built
+    template <size_t WordCount>
+    explicit StopWordSet(const StaticStopWords<WordCount>& words);
+
+    bool Contains(std::string_view word) const {
+        return filter_.MayContain(word) && Find(slots_.data(), slots_.size(), words_, word);
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+    std::vector<std::string>::const_iterator begin() const {
+        return words_.begin();
+    }
+
+    std::vector<std::string>::const_iterator end() const {
+        return words_.end();
+    }
+
+private:
+    void Build();
+
+    std::vector<std::string> words_;
+    std::vector<Slot> slots_;
+    Filter filter_;
+};
+
+// Stop words known at compile time, hashed by the compiler:
+//     constexpr StaticStopWords<3> STOP_WORDS({ "a"sv, "in"sv, "the"sv });
+template <size_t WordCount>
+class StaticStopWords {
+public:
+    // Empty and repeated words are skipped
+    constexpr explicit StaticStopWords(const std::array<std::string_view, WordCount>& words) {
+        for (const std::string_view word : words) {
+            if (!word.empty() && !Contains(word)) {
+                words_[word_count_] = word;
+                StopWordSet::Insert(slots_.data(), CAPACITY, static_cast<uint32_t>(word_count_), StopWordSet::Hash(word));
+                filter_.Add(word);
+                ++word_count_;
+            }
+        }
+    }
+
+    constexpr bool Contains(std::string_view word) const {
+        return filter_.MayContain(word) && StopWordSet::Find(slots_.data(), CAPACITY, words_, word);
+    }
+
+    constexpr size_t size() const {
+        return word_count_;
+    }
+
+    constexpr const std::string_view* begin() const {
+        return words_.data();
+    }
+
+    constexpr const std::string_view* end() const {
+        return words_.data() + word_count_;
+    }
+
+private:
+    friend class StopWordSet;
+
+    static constexpr size_t CAPACITY = StopWordSet::GetCapacity(WordCount);
+
+    std::array<std::string_view, WordCount> words_{};
+    size_t word_count_ = 0;
+    std::array<StopWordSet::Slot, CAPACITY> slots_{};
+    StopWordSet::Filter filter_;
+};
+
+template <typename StringContainer>
+StopWordSet::StopWordSet(const StringContainer& words) {
+    for (const std::string& word : MakeUniqueNonEmptyStrings(words)) {
+        words_.push_back(word);
+    }
+    Build();
+}
+
+template <size_t WordCount>
+StopWordSet::StopWordSet(const StaticStopWords<WordCount>& words)
+    : words_(words.begin(), words.end())
+    , slots_(words.slots_.begin(), words.slots_.end())
+    , filter_(words.filter_)
+{
+}
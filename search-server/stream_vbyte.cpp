@@ -0,0 +1,142 @@
+#include "stream_vbyte.h"
+#include <array>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define STREAM_VBYTE_SSSE3
+#endif
+using namespace std;
+
+namespace {
+
+size_t GetValueLength(uint8_t control, size_t index) {
+    return ((control >> (2 * index)) & 3) + 1;
+}
+
+// Decodes values [first, count) starting at data; base is the value before
+// the first one. Returns the end of the data read.
+template <bool IsDelta>
+const uint8_t* DecodeScalar(const uint8_t* control, const uint8_t* data, size_t first, size_t count,
+    uint32_t base, uint32_t* values) {
+    for (size_t i = first; i < count; ++i) {
+        const size_t length = GetValueLength(control[i / 4], i % 4);
+        uint32_t value = 0;
+        for (size_t byte = 0; byte < length; ++byte) {
+            value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+        }
+        data += length;
+        if constexpr (IsDelta) {
+            base += value;
+            value = base;
+        }
+        values[i] = value;
+    }
+    return data;
+}
+
+#ifdef STREAM_VBYTE_SSSE3
+
+struct ShuffleTable {
+    array<array<uint8_t, 16>, 256> masks;
+    array<uint8_t, 256> lengths;
+};
+
+// Shuffle mask that spreads the bytes of four values over four 32-bit lanes
+const ShuffleTable& GetShuffleTable() {
+    static const ShuffleTable table = [] {
+        ShuffleTable result;
+        for (size_t control = 0; control < 256; ++control) {
+            uint8_t source = 0;
+            for (size_t lane = 0; lane < 4; ++lane) {
+                const size_t length = GetValueLength(static_cast<uint8_t>(control), lane);
+                for (size_t byte = 0; byte < 4; ++byte) {
+                    result.masks[control][lane * 4 + byte] = byte < length ? source++ : 0x80;
+                }
+            }
+            result.lengths[control] = source;
+        }
+        return result;
+    }();
+    return table;
+}
+
+template <bool IsDelta>
+__attribute__((target("ssse3")))
+size_t DecodeSsse3(const uint8_t* input, size_t count, uint32_t base, uint32_t* values) {
+    const ShuffleTable& table = GetShuffleTable();
+    const uint8_t* control = input;
+    const uint8_t* data = input + (count + 3) / 4;
+    __m128i previous = _mm_set1_epi32(static_cast<int>(base));
+    const size_t full_count = count / 4 * 4;
+    for (size_t i = 0; i < full_count; i += 4) {
+        const uint8_t group_control = control[i / 4];
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        group = _mm_shuffle_epi8(group, _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.masks[group_control].data())));
+        data += table.lengths[group_control];
+        if constexpr (IsDelta) {
+            // Prefix sum of the four lanes plus the last value of the previous group
+            group = _mm_add_epi32(group, _mm_slli_si128(group, 4));
+            group = _mm_add_epi32(group, _mm_slli_si128(group, 8));
+            group = _mm_add_epi32(group, previous);
+            previous = _mm_shuffle_epi32(group, 0xFF);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), group);
+    }
+    const uint32_t last = full_count > 0 ? values[full_count - 1] : base;
+    return DecodeScalar<IsDelta>(control, data, full_count, count, last, values) - input;
+}
+
+bool HasSsse3() {
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    return has_ssse3;
+}
+
+#endif
+
+}  // namespace
+
+void EncodeStreamVByte(const uint32_t* values, size_t count, vector<uint8_t>& output) {
+    const size_t control_begin = output.size();
+    output.resize(control_begin + (count + 3) / 4, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t value = values[i];
+        const size_t length = value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+        output[control_begin + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+        for (size_t byte = 0; byte < length; ++byte) {
+            output.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+        }
+    }
+}
+
+size_t GetStreamVByteSize(const uint8_t* input, size_t count) {
+    size_t size = (count + 3) / 4;
+    for (size_t i = 0; i < count; ++i) {
+        size += GetValueLength(input[i / 4], i % 4);
+    }
+    return size;
+}
+
+size_t DecodeStreamVByte(const uint8_t* input, size_t count, uint32_t* values) {
+#ifdef STREAM_VBYTE_SSSE3
+    if (HasSsse3()) {
+        return DecodeSsse3<false>(input, count, 0, values);
+    }
+#endif
+    return DecodeStreamVByteScalar(input, count, values);
+}
+
+size_t DecodeStreamVByteDelta(const uint8_t* input, size_t count, uint32_t base, uint32_t* values) {
+#ifdef STREAM_VBYTE_SSSE3
+    if (HasSsse3()) {
+        return DecodeSsse3<true>(input, count, base, values);
+    }
+#endif
+    return DecodeStreamVByteDeltaScalar(input, count, base, values);
+}
+
+size_t DecodeStreamVByteScalar(const uint8_t* input, size_t count, uint32_t* values) {
+    return DecodeScalar<false>(input, input + (count + 3) / 4, 0, count, 0, values) - input;
+}
+
+size_t DecodeStreamVByteDeltaScalar(const uint8_t* input, size_t count, uint32_t base, uint32_t* values) {
+    return DecodeScalar<true>(input, input + (count + 3) / 4, 0, count, base, values) - input;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// StreamVByte integer codec. Each value takes 1 to 4 bytes; the byte counts
+// of four consecutive values are packed as 2-bit codes into one control
+// byte. All control bytes come first, followed by the value bytes, so a
+// group of four values is decoded with a single byte shuffle.
+
+// Appends the encoding of values to output
+void EncodeStreamVByte(const uint32_t* values, size_t count, std::vector<uint8_t>& output);
+
+// Size of the encoding of count values, found from the control bytes
+size_t GetStreamVByteSize(const uint8_t* input, size_t count);
+
+// Decodes count values and returns the number of bytes read. The input has
+// to stay readable for 16 bytes past the encoded data.
+size_t DecodeStreamVByte(const uint8_t* input, size_t count, uint32_t* values);
+
+// Same as DecodeStreamVByte for values encoded as differences: the i-th
+// output is base plus the sum of the first i + 1 decoded values
+size_t DecodeStreamVByteDelta(const uint8_t* input, size_t count, uint32_t base, uint32_t* values);
+
+// Portable decoders without SIMD, which the dispatching ones above fall back
+// to on CPUs without SSSE3
+size_t DecodeStreamVByteScalar(const uint8_t* input, size_t count, uint32_t* values);
+
+size_t DecodeStreamVByteDeltaScalar(const uint8_t* input, size_t count, uint32_t base, uint32_t* values);
@@ -1,18 +1,114 @@
 #include "string_processing.h"
+#include <cstring>
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define STRING_PROCESSING_SSE2
+#endif
 
 using namespace std;
 
+namespace {
+
+#ifdef STRING_PROCESSING_SSE2
+
+SeparatorMasks FindSeparatorsSse2(const char* data) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    SeparatorMasks masks;
+    for (size_t i = 0; i < SEPARATOR_BLOCK_SIZE; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // Unsigned chunk <= ' ' - 1
+        const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk);
+        masks.spaces |= uint64_t{ static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces))) } << i;
+        masks.controls |= uint64_t{ static_cast<uint16_t>(_mm_movemask_epi8(controls)) } << i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2")))
+SeparatorMasks FindSeparatorsAvx2(const char* data) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    SeparatorMasks masks;
+    for (size_t i = 0; i < SEPARATOR_BLOCK_SIZE; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, last_control), chunk);
+        masks.spaces |= uint64_t{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, spaces))) } << i;
+        masks.controls |= uint64_t{ static_cast<uint32_t>(_mm256_movemask_epi8(controls)) } << i;
+    }
+    return masks;
+}
+
+#else
+
+SeparatorMasks FindSeparatorsScalar(const char* data) {
+    SeparatorMasks masks;
+    for (size_t i = 0; i < SEPARATOR_BLOCK_SIZE; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        masks.spaces |= uint64_t{ c == ' ' } << i;
+        masks.controls |= uint64_t{ c < ' ' } << i;
+    }
+    return masks;
+}
+
+#endif
+
+using FindSeparatorsFunc = SeparatorMasks(*)(const char*);
+
+FindSeparatorsFunc ChooseFindSeparators() {
+#ifdef STRING_PROCESSING_SSE2
+    if (__builtin_cpu_supports("avx2")) {
+        return FindSeparatorsAvx2;
+    }
+    return FindSeparatorsSse2;
+#else
+    return FindSeparatorsScalar;
+#endif
+}
+
+}  // namespace
+
 vector<string_view> SplitIntoWords(string_view str) {
     vector<string_view> result;
-    str.remove_prefix(min(str.size(), str.find_first_not_of(" ")));
-    const int64_t pos_end = str.npos;
-
-    while (!str.empty()) {
-        int64_t space = str.find(" ");
-        result.push_back(space == pos_end ? str.substr(0, pos_end) : str.substr(0, space));
-        str.remove_prefix(min(str.size(), str.find(" ")));
-        str.remove_prefix(min(str.size(), str.find_first_not_of(" ")));
+    ForEachWord(str, [&result](string_view word) {
+        result.push_back(word);
+        });
+    return result;
+}
+
+SeparatorMasks FindSeparators(const char* data, size_t size) {
+    static const FindSeparatorsFunc find_separators = ChooseFindSeparators();
+    if (size < SEPARATOR_BLOCK_SIZE) {
+        char block[SEPARATOR_BLOCK_SIZE];
+        memset(block, ' ', SEPARATOR_BLOCK_SIZE);
+        memcpy(block, data, size);
+        return find_separators(block);
     }
+    return find_separators(data);
+}
 
-    return result;
-}
\ No newline at end of file
+size_t FindSeparator(string_view str, size_t pos, char extra) {
+#ifdef STRING_PROCESSING_SSE2
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i extras = _mm_set1_epi8(extra);
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    for (; pos + 16 <= str.size(); pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+        // Unsigned chunk <= ' ' - 1
+        const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk);
+        const __m128i matches = _mm_or_si128(controls,
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, spaces), _mm_cmpeq_epi8(chunk, extras)));
+        const int mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; pos < str.size(); ++pos) {
+        const unsigned char c = static_cast<unsigned char>(str[pos]);
+        if (c <= ' ' || str[pos] == extra) {
+            return pos;
+        }
+    }
+    return str.size();
+}
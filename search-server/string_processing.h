@@ -1,12 +1,66 @@
 #pragma once
+#include <cstdint>
 #include <iostream>
 #include <string_view>
 #include <string>
 #include <vector>
 #include <set>
+#include <algorithm>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
 
+struct SeparatorMasks {
+    uint64_t spaces = 0;
+    uint64_t controls = 0;
+};
+
+inline constexpr size_t SEPARATOR_BLOCK_SIZE = 64;
+
+// Bit i of the masks is set if byte i of data is a space or a control
+// character. Bytes from size to SEPARATOR_BLOCK_SIZE count as spaces.
+// Uses AVX2 or SSE2 when the processor has them.
+SeparatorMasks FindSeparators(const char* data, size_t size = SEPARATOR_BLOCK_SIZE);
+
+inline int CountTrailingZeros(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    for (; (value & 1) == 0; value >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Calls func(word) for the words of str separated by spaces, in one pass.
+// Returns false if str contains control characters; they stay inside words.
+template <typename Func>
+bool ForEachWord(std::string_view str, Func func) {
+    uint64_t controls = 0;
+    size_t word_begin = 0;
+    for (size_t block = 0; block < str.size(); block += SEPARATOR_BLOCK_SIZE) {
+        const SeparatorMasks masks = FindSeparators(str.data() + block, std::min(SEPARATOR_BLOCK_SIZE, str.size() - block));
+        controls |= masks.controls;
+        for (uint64_t spaces = masks.spaces; spaces != 0; spaces &= spaces - 1) {
+            const size_t pos = block + CountTrailingZeros(spaces);
+            if (pos > word_begin) {
+                func(str.substr(word_begin, pos - word_begin));
+            }
+            word_begin = pos + 1;
+        }
+    }
+    // The padding of a short last block ends the last word otherwise
+    if (word_begin < str.size()) {
+        func(str.substr(word_begin));
+    }
+    return controls == 0;
+}
+
+// Position of the first space, control character or extra character at or
+// after pos; str.size() if there is none
+size_t FindSeparator(std::string_view str, size_t pos, char extra);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -0,0 +1,85 @@
+#include "term_dictionary.h"
+using namespace std;
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : entries_(other.entries_)
+    , free_ids_(other.free_ids_) {
+    word_to_id_.reserve(other.word_to_id_.size());
+    for (int term_id = 0; term_id < static_cast<int>(entries_.size()); ++term_id) {
+        if (entries_[term_id].ref_count > 0) {
+            word_to_id_.emplace(entries_[term_id].word, term_id);
+        }
+    }
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+int TermDictionary::Intern(string_view word, int ref_count) {
+    if (const auto it = word_to_id_.find(word); it != word_to_id_.end()) {
+        entries_[it->second].ref_count += ref_count;
+        return it->second;
+    }
+    int term_id;
+    if (!free_ids_.empty()) {
+        term_id = free_ids_.back();
+        free_ids_.pop_back();
+        entries_[term_id].word = string{ word };
+    }
+    else {
+        term_id = static_cast<int>(entries_.size());
+        entries_.push_back({ string{ word }, 0 });
+    }
+    entries_[term_id].ref_count = ref_count;
+    word_to_id_.emplace(entries_[term_id].word, term_id);
+    return term_id;
+}
+
+bool TermDictionary::Release(int term_id) {
+    Entry& entry = entries_.at(term_id);
+    if (--entry.ref_count > 0) {
+        return false;
+    }
+    word_to_id_.erase(entry.word);
+    entry.word.clear();
+    entry.word.shrink_to_fit();
+    free_ids_.push_back(term_id);
+    return true;
+}
+
+int TermDictionary::Find(string_view word) const {
+    const auto it = word_to_id_.find(word);
+    return it == word_to_id_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetWord(int term_id) const {
+    return entries_.at(term_id).word;
+}
+
+int TermDictionary::GetRefCount(int term_id) const {
+    return entries_.at(term_id).ref_count;
+}
+
+int TermDictionary::GetIdBound() const {
+    return static_cast<int>(entries_.size());
+}
+
+int TermDictionary::GetTermCount() const {
+    return static_cast<int>(word_to_id_.size());
+}
+
+void TermDictionary::AppendTerm(string_view word, int ref_count) {
+    const int term_id = static_cast<int>(entries_.size());
+    entries_.push_back({ string{ word }, ref_count });
+    if (ref_count == 0) {
+        free_ids_.push_back(term_id);
+    }
+    else {
+        word_to_id_.emplace(entries_.back().word, term_id);
+    }
+}
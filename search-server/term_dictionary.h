@@ -0,0 +1,55 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Stores every distinct word once and assigns it a dense integer id.
+// Ids are reference counted: a word is freed when its last occurrence
+// is released and its id is reused by the next new word.
+class TermDictionary {
+public:
+    inline static constexpr int NO_TERM = -1;
+
+    TermDictionary() = default;
+
+    // The word index points into the stored words, so a copy rebuilds it
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of the word and adds ref_count references to it
+    int Intern(std::string_view word, int ref_count = 1);
+
+    // Drops a reference and returns true if it was the last one and the id was freed
+    bool Release(int term_id);
+
+    int Find(std::string_view word) const;
+
+    std::string_view GetWord(int term_id) const;
+
+    int GetRefCount(int term_id) const;
+
+    // Upper bound of the ids in use, suitable for sizing id-indexed arrays
+    int GetIdBound() const;
+
+    int GetTermCount() const;
+
+    // Adds the next id while restoring a saved dictionary. An empty word with
+    // a zero count marks an id that was free.
+    void AppendTerm(std::string_view word, int ref_count);
+
+private:
+    struct Entry {
+        std::string word;
+        int ref_count = 0;
+    };
+
+    // deque keeps the addresses of the stored words stable
+    std::deque<Entry> entries_;
+    std::vector<int> free_ids_;
+    std::unordered_map<std::string_view, int> word_to_id_;
+};
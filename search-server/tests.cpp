@@ -0,0 +1,828 @@
+#include "tests.h"
+#include "concurrent_search_server.h"
+#include "document_filter.h"
+#include "fingerprint.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "stream_vbyte.h"
+#include "string_processing.h"
+#include "test_framework.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+void AssertEqualDocuments(const vector<Document>& lhs, const vector<Document>& rhs, const string& hint) {
+    ASSERT_EQUAL(lhs.size(), rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        AssertEqual(lhs[i].id, rhs[i].id, hint);
+        AssertEqual(lhs[i].relevance, rhs[i].relevance, hint);
+        AssertEqual(lhs[i].rating, rhs[i].rating, hint);
+    }
+}
+
+// Random texts of frequent and rare words, half of the words frequent
+vector<string> GenerateTexts(mt19937& generator, int text_count, int max_word_count) {
+    vector<string> texts(text_count);
+    for (string& text : texts) {
+        const int word_count = 1 + generator() % max_word_count;
+        for (int i = 0; i < word_count; ++i) {
+            const int word = generator() % 2 == 0 ? generator() % 20 : generator() % 2000;
+            text += "w"s + to_string(word) + " "s;
+        }
+    }
+    return texts;
+}
+
+void TestSnapshotSavedOverLoadedFile() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snap").string();
+    const vector<string> queries = { "cat"s, "curly dog"s, "nasty -cat"s, "fluffy tail eyes"s };
+    {
+        SearchServer server("and with"s);
+        server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 3 });
+        server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::BANNED, { 5 });
+        server.AddDocument(4, "nasty pigeon john"s, DocumentStatus::ACTUAL, { -1 });
+        server.RemoveDocument(4);
+        server.SaveSnapshot(path);
+    }
+    SearchServer loaded = SearchServer::LoadSnapshot(path, true);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), 3);
+    // The loaded server still reads the file it replaces
+    loaded.AddDocument(5, "fluffy dog fluffy tail"s, DocumentStatus::ACTUAL, { 4 });
+    loaded.RemoveDocument(1);
+    loaded.SaveSnapshot(path);
+    ASSERT(!filesystem::exists(path + ".tmp"s));
+
+    const SearchServer reloaded = SearchServer::LoadSnapshot(path, true);
+    ASSERT_EQUAL(reloaded.GetDocumentCount(), loaded.GetDocumentCount());
+    for (const string& query : queries) {
+        AssertEqualDocuments(reloaded.FindTopDocuments(query), loaded.FindTopDocuments(query), query);
+        AssertEqualDocuments(reloaded.FindTopDocuments(query, DocumentStatus::BANNED),
+            loaded.FindTopDocuments(query, DocumentStatus::BANNED), query);
+    }
+    const auto [words, status] = reloaded.MatchDocument("fluffy tail"s, 5);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(status == DocumentStatus::ACTUAL);
+    ASSERT_THROWS(reloaded.MatchDocument("cat"s, 1), out_of_range);
+    filesystem::remove(path);
+}
+
+// Pruned sequential search must match exhaustive parallel search bit for bit
+void TestPrunedSearchMatchesExhaustive() {
+    mt19937 generator(42);
+    vector<string> words;
+    for (int i = 0; i < 2000; ++i) {
+        words.push_back("w"s + to_string(i));
+    }
+    // Half the words are drawn from the 20 frequent ones
+    auto draw_word = [&]() -> const string& {
+        const int index = generator() % 2 == 0 ? generator() % 20 : generator() % words.size();
+        return words[index];
+    };
+    const int document_count = 20000;
+    vector<string> texts(document_count);
+    vector<NewDocument> documents;
+    for (int id = 0; id < document_count; ++id) {
+        const int length = 5 + generator() % 30;
+        for (int i = 0; i < length; ++i) {
+            texts[id] += draw_word();
+            texts[id] += ' ';
+        }
+        documents.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 3), { static_cast<int>(generator() % 10) } });
+    }
+    SearchServer server("and in on"s);
+    server.AddDocuments(documents);
+
+    vector<string> queries;
+    for (int i = 0; i < 300; ++i) {
+        string query;
+        const int length = 2 + generator() % 7;
+        for (int j = 0; j < length; ++j) {
+            query += j > 0 && generator() % 8 == 0 ? "-"s : ""s;
+            query += draw_word();
+            query += ' ';
+        }
+        queries.push_back(query);
+    }
+    auto check = [&]() {
+        for (const string& query : queries) {
+            AssertEqualDocuments(server.FindTopDocuments(execution::seq, query),
+                server.FindTopDocuments(execution::par, query), query);
+            AssertEqualDocuments(server.FindTopDocuments(execution::seq, query, DocumentStatus::BANNED, 20),
+                server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED, 20), query);
+        }
+    };
+    check();
+    for (int id = 0; id < document_count; id += 1 + generator() % 4) {
+        server.RemoveDocument(id);
+    }
+    check();
+    server.Compact();
+    check();
+}
+
+void TestTopDocumentsOrder() {
+    SearchServer server(""s);
+    server.AddDocument(5, "cat dog"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(2, "dog cat"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(7, "cat dog"s, DocumentStatus::ACTUAL, { 9 });
+    server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(4, "cat"s, DocumentStatus::ACTUAL, { 0 });
+    server.AddDocument(3, "bird"s, DocumentStatus::ACTUAL, { 5 });
+    // Equal relevances are ordered by rating, then by id
+    vector<int> ids;
+    for (const Document& document : server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 10)) {
+        ids.push_back(document.id);
+    }
+    ASSERT_EQUAL(ids, (vector<int>{ 4, 7, 2, 5, 1 }));
+}
+
+void TestTopDocumentsMatchFullSort() {
+    mt19937 generator(3);
+    const vector<string> texts = GenerateTexts(generator, 3000, 20);
+    SearchServer server(""s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { static_cast<int>(generator() % 5) });
+    }
+    for (const string& query : { "w1 w2"s, "w3"s, "w5 w700 w1500"s, "w0 w1 w2 w3 -w4"s }) {
+        vector<Document> all = server.FindTopDocuments(query, DocumentStatus::ACTUAL, static_cast<int>(texts.size()));
+        sort(all.begin(), all.end(), [](const Document& lhs, const Document& rhs) {
+            if (abs(lhs.relevance - rhs.relevance) < SearchServer::MIN) {
+                return lhs.rating == rhs.rating ? lhs.id < rhs.id : lhs.rating > rhs.rating;
+            }
+            return lhs.relevance > rhs.relevance;
+            });
+        ASSERT(all.size() > SearchServer::MAX_RESULT_DOCUMENT_COUNT);
+        all.resize(SearchServer::MAX_RESULT_DOCUMENT_COUNT);
+        AssertEqualDocuments(server.FindTopDocuments(query), all, query);
+    }
+}
+
+void TestQuotaLimitsWorkers() {
+    ThreadPool pool(4);
+    const thread::id caller = this_thread::get_id();
+    for (const size_t max_workers : { 0u, 1u, 2u }) {
+        ThreadPool::Quota quota(max_workers);
+        atomic<int> running_workers{ 0 };
+        atomic<int> max_running_workers{ 0 };
+        atomic<int> caller_tasks{ 0 };
+        atomic<int> done_tasks{ 0 };
+        pool.ParallelFor(64, [&](size_t) {
+            if (this_thread::get_id() == caller) {
+                ++caller_tasks;
+            }
+            else {
+                const int running = ++running_workers;
+                int max_running = max_running_workers.load();
+                while (running > max_running && !max_running_workers.compare_exchange_weak(max_running, running)) {
+                }
+            }
+            this_thread::sleep_for(chrono::microseconds(200));
+            if (this_thread::get_id() != caller) {
+                --running_workers;
+            }
+            ++done_tasks;
+        }, &quota);
+        ASSERT_EQUAL(done_tasks.load(), 64);
+        ASSERT(max_running_workers.load() <= static_cast<int>(max_workers));
+        // Helpers over the quota leave the tasks to the others
+        if (max_workers == 0) {
+            ASSERT_EQUAL(caller_tasks.load(), 64);
+        }
+    }
+}
+
+void TestFlatBatchMatchesProcessQueries() {
+    mt19937 generator(8);
+    const vector<string> texts = GenerateTexts(generator, 2000, 10);
+    SearchServer server(""s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { 1 });
+    }
+    // Queries with full, partial and empty results
+    vector<string> queries = GenerateTexts(generator, 200, 3);
+    queries.push_back("absent"s);
+    queries.insert(queries.begin(), "w1 -w1"s);
+    const vector<vector<Document>> expected = ProcessQueries(server, queries);
+    const QueryBatchResults flat = ProcessQueriesFlat(server, queries);
+    const vector<Document> joined = ProcessQueriesJoined(server, queries);
+    ASSERT_EQUAL(flat.offsets.size(), queries.size() + 1);
+    ASSERT_EQUAL(flat.offsets[0], 0u);
+    vector<Document> expected_joined;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_EQUAL(flat.offsets[i + 1] - flat.offsets[i], expected[i].size());
+        const vector<Document> documents(flat.documents.begin() + flat.offsets[i], flat.documents.begin() + flat.offsets[i + 1]);
+        AssertEqualDocuments(documents, expected[i], queries[i]);
+        expected_joined.insert(expected_joined.end(), expected[i].begin(), expected[i].end());
+    }
+    AssertEqualDocuments(joined, expected_joined, "joined"s);
+}
+
+// A snapshot with any byte flipped must fail to load with runtime_error
+// rather than crash, and the structural checks alone must keep it usable
+void TestCorruptedSnapshotThrows() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snap").string();
+    const string corrupted_path = path + ".corrupted"s;
+    {
+        SearchServer server("and with"s);
+        server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 });
+        server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 3 });
+        server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::BANNED, { 5 });
+        server.AddDocument(4, "nasty pigeon john"s, DocumentStatus::ACTUAL, { -1 });
+        server.RemoveDocument(4);
+        server.SaveSnapshot(path);
+    }
+    string snapshot;
+    {
+        ifstream input(path, ios::binary);
+        snapshot.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    filesystem::remove(path);
+    for (size_t pos = 0; pos < snapshot.size(); ++pos) {
+        snapshot[pos] ^= 0x5A;
+        {
+            ofstream output(corrupted_path, ios::binary | ios::trunc);
+            output.write(snapshot.data(), snapshot.size());
+        }
+        snapshot[pos] ^= 0x5A;
+        const string hint = "byte "s + to_string(pos);
+        bool thrown = false;
+        try {
+            SearchServer::LoadSnapshot(corrupted_path, true);
+        }
+        catch (const runtime_error&) {
+            thrown = true;
+        }
+        Assert(thrown, hint);
+        try {
+            const SearchServer server = SearchServer::LoadSnapshot(corrupted_path);
+            for (const string& query : { "cat"s, "curly -dog"s, "nasty eyes"s }) {
+                server.FindTopDocuments(query);
+                server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED);
+                for (const int document_id : server) {
+                    server.MatchDocument(query, document_id);
+                }
+            }
+        }
+        catch (const runtime_error&) {
+        }
+    }
+    filesystem::remove(corrupted_path);
+}
+
+// A batch with one invalid document must throw and add nothing, and a valid
+// batch must index exactly like sequential AddDocument calls
+void TestAddDocumentsBatch() {
+    mt19937 generator(10);
+    const vector<string> texts = GenerateTexts(generator, 300, 12);
+    const vector<string> queries = { "w1 w2 w3"s, "w5 -w7"s, "w100 w1500 w19"s, "w0"s };
+    auto make_batch = [&](int first_id, int count) {
+        vector<NewDocument> batch;
+        for (int id = first_id; id < first_id + count; ++id) {
+            batch.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 2), { id % 7, -(id % 3) } });
+        }
+        return batch;
+    };
+
+    SearchServer sequential("w4"s);
+    for (const NewDocument& document : make_batch(0, 300)) {
+        sequential.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    SearchServer batched("w4"s);
+    batched.AddDocuments(make_batch(0, 100));
+    const int document_count = batched.GetDocumentCount();
+    const vector<Document> before = batched.FindTopDocuments("w1 w2 w3"s);
+
+    const string bad_text = "w1 w\x12"s;
+    vector<vector<NewDocument>> invalid_batches(3, make_batch(100, 200));
+    invalid_batches[0][150].id = 5;
+    invalid_batches[1][150].id = -1;
+    invalid_batches[2][150].text = bad_text;
+    for (const vector<NewDocument>& batch : invalid_batches) {
+        ASSERT_THROWS(batched.AddDocuments(batch), invalid_argument);
+        ASSERT_EQUAL(batched.GetDocumentCount(), document_count);
+        ASSERT_THROWS(batched.GetWordFrequencies(100), out_of_range);
+        AssertEqualDocuments(batched.FindTopDocuments("w1 w2 w3"s), before, "w1 w2 w3"s);
+    }
+    vector<NewDocument> repeated_batch = make_batch(100, 200);
+    repeated_batch[150].id = 120;
+    ASSERT_THROWS(batched.AddDocuments(repeated_batch), invalid_argument);
+    ASSERT_EQUAL(batched.GetDocumentCount(), document_count);
+
+    batched.AddDocuments(make_batch(100, 200));
+    ASSERT_EQUAL(batched.GetDocumentCount(), sequential.GetDocumentCount());
+    ASSERT(equal(batched.begin(), batched.end(), sequential.begin(), sequential.end()));
+    for (const string& query : queries) {
+        AssertEqualDocuments(batched.FindTopDocuments(query), sequential.FindTopDocuments(query), query);
+        AssertEqualDocuments(batched.FindTopDocuments(query, DocumentStatus::IRRELEVANT),
+            sequential.FindTopDocuments(query, DocumentStatus::IRRELEVANT), query);
+    }
+    for (int id = 0; id < 300; id += 37) {
+        ASSERT(batched.GetWordFrequencies(id) == sequential.GetWordFrequencies(id));
+        ASSERT(batched.MatchDocument("w1 w2 w3 w5"s, id) == sequential.MatchDocument("w1 w2 w3 w5"s, id));
+    }
+}
+
+// Compact drops removed documents and renumbers the ordinals of the rest
+// without changing any result
+void TestCompactKeepsResults() {
+    mt19937 generator(11);
+    const vector<string> texts = GenerateTexts(generator, 400, 15);
+    const vector<string> queries = { "w1 w2 w3"s, "w5 -w7"s, "w100 w1500 w19"s, "w0 w11 -w12"s };
+    SearchServer server("w4"s);
+    SearchServer reference("w4"s);
+    for (int id = 0; id < 400; ++id) {
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 9 });
+        if (id % 3 != 0) {
+            reference.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 9 });
+        }
+        if (id % 100 == 99) {
+            server.Flush();
+        }
+    }
+    for (int id = 0; id < 400; id += 3) {
+        server.RemoveDocument(id);
+    }
+    ASSERT(server.GetRemovedDocumentCount() > 0);
+
+    auto check_results = [&](const SearchServer& expected, const string& hint) {
+        for (const string& query : queries) {
+            for (const DocumentStatus status : { DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+                AssertEqualDocuments(server.FindTopDocuments(query, status), expected.FindTopDocuments(query, status), hint + query);
+                AssertEqualDocuments(server.FindTopDocuments(execution::par, query, status),
+                    expected.FindTopDocuments(query, status), hint + query);
+            }
+        }
+        ASSERT(equal(server.begin(), server.end(), expected.begin(), expected.end()));
+        for (int id = 1; id < 400; id += 3) {
+            AssertEqual(server.GetWordFrequencies(id) == expected.GetWordFrequencies(id), true, hint);
+            AssertEqual(server.MatchDocument(queries[id % 4], id) == expected.MatchDocument(queries[id % 4], id), true, hint);
+        }
+    };
+    check_results(reference, "before Compact: "s);
+    server.Compact();
+    ASSERT_EQUAL(server.GetRemovedDocumentCount(), 0);
+    ASSERT_EQUAL(server.GetSegmentCount(), 1);
+    ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+    ASSERT_THROWS(server.MatchDocument("w1"s, 0), out_of_range);
+    check_results(reference, "after Compact: "s);
+
+    // Documents added to the compacted server get ordinals after the renumbered ones
+    for (int id = 400; id < 450; ++id) {
+        const string text = "w1 w3 w"s + to_string(id);
+        server.AddDocument(id, text, DocumentStatus::BANNED, { 1 });
+        reference.AddDocument(id, text, DocumentStatus::BANNED, { 1 });
+    }
+    check_results(reference, "after adding: "s);
+}
+
+// Readers running during updates must see the state before or after each
+// update, never a mix, and never go back to an older one
+void TestConcurrentReadersSeeWholeUpdates() {
+    constexpr int UPDATE_COUNT = 60;
+    constexpr int FIRST_ADDED_ID = 1000;
+    SearchServer initial("and"s);
+    for (int id = 0; id < 20; ++id) {
+        initial.AddDocument(id, "cat and dog "s + to_string(id), DocumentStatus::ACTUAL, { id });
+    }
+    ConcurrentSearchServer server(initial);
+
+    // Update k adds a document with the word "marker"; updates that throw change nothing
+    atomic<bool> done = false;
+    atomic<int> failure_count = 0;
+    auto read = [&] {
+        int last_update = 0;
+        while (!done.load()) {
+            const bool consistent = server.Read([&](const SearchServer& search_server) {
+                const int update = search_server.GetDocumentCount() - 20;
+                vector<int> ids(search_server.begin(), search_server.end());
+                vector<int> expected_ids(20);
+                iota(expected_ids.begin(), expected_ids.end(), 0);
+                for (int k = 0; k < update; ++k) {
+                    expected_ids.push_back(FIRST_ADDED_ID + k);
+                }
+                const vector<Document> found = search_server.FindTopDocuments("marker"s);
+                const bool valid = update >= last_update && ids == expected_ids
+                    && found.size() == static_cast<size_t>(min(update, SearchServer::MAX_RESULT_DOCUMENT_COUNT));
+                last_update = update;
+                return valid;
+                });
+            if (!consistent) {
+                ++failure_count;
+            }
+        }
+    };
+    vector<thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back(read);
+    }
+    for (int k = 0; k < UPDATE_COUNT; ++k) {
+        server.Update([k](SearchServer& search_server) {
+            search_server.AddDocument(FIRST_ADDED_ID + k, "marker cat "s + to_string(k), DocumentStatus::ACTUAL, { k });
+            });
+        if (k % 10 == 0) {
+            ASSERT_THROWS(server.Update([](SearchServer& search_server) {
+                search_server.AddDocument(0, "marker"s, DocumentStatus::ACTUAL, {});
+                }), invalid_argument);
+        }
+    }
+    done = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQUAL(failure_count.load(), 0);
+    ASSERT_EQUAL(server.Read([](const SearchServer& search_server) { return search_server.GetDocumentCount(); }), 20 + UPDATE_COUNT);
+}
+
+// StreamVByte must round-trip any count and every value length, and the
+// dispatching decoders must agree with the scalar ones
+void TestStreamVByteRoundTrip() {
+    const vector<uint32_t> boundaries = { 0, 1, 255, 256, 65535, 65536, (1u << 24) - 1, 1u << 24, UINT32_MAX };
+    mt19937 generator(14);
+    for (size_t count = 0; count <= 70; ++count) {
+        vector<uint32_t> values(count);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = count % 2 == 0 ? boundaries[(i + count) % boundaries.size()]
+                : static_cast<uint32_t>(generator()) >> (8 * (generator() % 4));
+        }
+        vector<uint8_t> encoded;
+        EncodeStreamVByte(values.data(), count, encoded);
+        const size_t size = encoded.size();
+        ASSERT_EQUAL(GetStreamVByteSize(encoded.data(), count), size);
+        // Decoders may read 16 bytes past the data
+        encoded.resize(size + 16, 0xFF);
+        const string hint = "count "s + to_string(count);
+
+        vector<uint32_t> decoded(count + 1, 7);
+        vector<uint32_t> decoded_scalar(count + 1, 7);
+        AssertEqual(DecodeStreamVByte(encoded.data(), count, decoded.data()), size, hint);
+        AssertEqual(DecodeStreamVByteScalar(encoded.data(), count, decoded_scalar.data()), size, hint);
+        AssertEqual(vector<uint32_t>(decoded.begin(), decoded.end() - 1), values, hint);
+        AssertEqual(decoded_scalar, decoded, hint);
+
+        // The values as gaps after a base, the sums wrapping around like the encoder's differences
+        const uint32_t base = static_cast<uint32_t>(generator());
+        vector<uint32_t> sums(count);
+        uint32_t sum = base;
+        for (size_t i = 0; i < count; ++i) {
+            sum += values[i];
+            sums[i] = sum;
+        }
+        AssertEqual(DecodeStreamVByteDelta(encoded.data(), count, base, decoded.data()), size, hint);
+        AssertEqual(DecodeStreamVByteDeltaScalar(encoded.data(), count, base, decoded_scalar.data()), size, hint);
+        AssertEqual(vector<uint32_t>(decoded.begin(), decoded.end() - 1), sums, hint);
+        AssertEqual(decoded_scalar, decoded, hint);
+    }
+}
+
+// Cached results must equal computed ones and go stale on every change of
+// the documents
+void TestResultCache() {
+    const vector<string> texts = { "white cat and yellow hat"s, "curly cat curly tail"s, "nasty dog with big eyes"s,
+        "nasty pigeon john"s, "cat with a tail"s, "big cat"s };
+    SearchServer server("and with"s);
+    SearchServer uncached("and with"s);
+    for (int id = 0; id < 4; ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+        uncached.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+    }
+    server.SetResultCacheCapacity(100);
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    auto check_query = [&](const string& query, bool expect_hit) {
+        const vector<Document> result = server.FindTopDocuments(query);
+        AssertEqualDocuments(result, uncached.FindTopDocuments(query), query);
+        (expect_hit ? hits : misses) += 1;
+        const ResultCache::Stats stats = server.GetResultCacheStats();
+        AssertEqual(stats.hits, hits, query);
+        AssertEqual(stats.misses, misses, query);
+    };
+    check_query("cat tail"s, false);
+    check_query("cat tail"s, true);
+    check_query("nasty -john"s, false);
+    check_query("nasty -john"s, true);
+    ASSERT_EQUAL(server.FindTopDocuments("cat tail"s, DocumentStatus::BANNED).size(), 0u);
+    ++misses;
+
+    server.AddDocument(4, texts[4], DocumentStatus::ACTUAL, { 4 });
+    uncached.AddDocument(4, texts[4], DocumentStatus::ACTUAL, { 4 });
+    check_query("cat tail"s, false);
+    check_query("cat tail"s, true);
+
+    server.AddDocuments({ { 5, texts[5], DocumentStatus::ACTUAL, { 5 } } });
+    uncached.AddDocuments({ { 5, texts[5], DocumentStatus::ACTUAL, { 5 } } });
+    check_query("cat tail"s, false);
+
+    server.RemoveDocument(1);
+    uncached.RemoveDocument(1);
+    check_query("cat tail"s, false);
+    check_query("cat tail"s, true);
+
+    server.Compact();
+    uncached.Compact();
+    check_query("cat tail"s, false);
+    check_query("cat tail"s, true);
+
+    server.SetResultCacheCapacity(0);
+    for (int i = 0; i < 2; ++i) {
+        AssertEqualDocuments(server.FindTopDocuments("cat tail"s), uncached.FindTopDocuments("cat tail"s), "cat tail"s);
+    }
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 0u);
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 0u);
+}
+
+// Plus and minus words of a query as the parser before the single-pass one
+// found them: minus checks first, then control characters, then the words
+// split by SplitIntoWords without stop words
+pair<set<string>, set<string>> ParseQueryBySplitting(const string& text, const set<string>& stop_words) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '-' && i + 1 < text.size() && text[i + 1] == '-') {
+            throw invalid_argument("Добавлено два символа «минус» подряд"s);
+        }
+        else if ((text[i] == '-' && (i + 1 == text.size() || text[i + 1] == ' ')) || text.back() == '-') {
+            throw invalid_argument("Отсутствие текста после символа «минус»"s);
+        }
+    }
+    if (any_of(text.begin(), text.end(), [](char c) { return c >= '\0' && c < ' '; })) {
+        throw invalid_argument("Текст запроса содержит недопустимые символы"s);
+    }
+    pair<set<string>, set<string>> words;
+    for (string_view word : SplitIntoWords(text)) {
+        const bool is_minus = word[0] == '-';
+        if (is_minus) {
+            word.remove_prefix(1);
+        }
+        if (stop_words.count(string{ word }) == 0) {
+            (is_minus ? words.second : words.first).insert(string{ word });
+        }
+    }
+    return words;
+}
+
+// Malformed queries must throw the same errors as before, and valid ones
+// match the same documents
+void TestParseQueryMatchesSplitting() {
+    const set<string> stop_words = { "and"s, "with"s };
+    SearchServer server("and with"s);
+    server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "cat-dog tail"s, DocumentStatus::ACTUAL, { 4 });
+    const vector<string> queries = { "cat -"s, "--cat"s, "-"s, "cat --dog"s, "cat - dog"s, "cat-"s, "ca\x01t"s,
+        "cat \x1F-"s, "cat -and"s, "cat -with dog"s, "and with"s, "cat cat -dog -dog"s, "curly -curly"s,
+        "  cat   tail  "s, ""s, "cat-dog"s, "tail -cat-dog"s, "-white -nasty"s, "dog -eyes- tail"s, "cat --dog -"s };
+    for (const string& query : queries) {
+        string expected_error;
+        pair<set<string>, set<string>> words;
+        try {
+            words = ParseQueryBySplitting(query, stop_words);
+        }
+        catch (const invalid_argument& error) {
+            expected_error = error.what();
+        }
+        vector<int> expected_ids;
+        for (const int document_id : server) {
+            vector<string_view> expected_words;
+            bool has_minus_word = false;
+            for (const auto& [word, freq] : server.GetWordFrequencies(document_id)) {
+                has_minus_word = has_minus_word || words.second.count(string{ word }) > 0;
+                if (words.first.count(string{ word }) > 0) {
+                    expected_words.push_back(word);
+                }
+            }
+            if (has_minus_word) {
+                expected_words.clear();
+            }
+            else if (!expected_words.empty()) {
+                expected_ids.push_back(document_id);
+            }
+            for (const bool parallel : { false, true }) {
+                string error;
+                try {
+                    const auto [matched_words, status] = parallel ? server.MatchDocument(execution::par, query, document_id)
+                        : server.MatchDocument(query, document_id);
+                    AssertEqual(matched_words, expected_words, query);
+                }
+                catch (const invalid_argument& exception) {
+                    error = exception.what();
+                }
+                AssertEqual(error, expected_error, query);
+            }
+        }
+        string error;
+        try {
+            vector<int> ids;
+            for (const Document& document : server.FindTopDocuments(query)) {
+                ids.push_back(document.id);
+            }
+            sort(ids.begin(), ids.end());
+            AssertEqual(ids, expected_ids, query);
+        }
+        catch (const invalid_argument& exception) {
+            error = exception.what();
+        }
+        AssertEqual(error, expected_error, query);
+    }
+}
+
+// Runs func with cout captured, as the removal functions report to it
+template <typename Func>
+string CaptureOutput(Func func) {
+    ostringstream output;
+    streambuf* const old_buffer = cout.rdbuf(output.rdbuf());
+    try {
+        func();
+    }
+    catch (...) {
+        cout.rdbuf(old_buffer);
+        throw;
+    }
+    cout.rdbuf(old_buffer);
+    return output.str();
+}
+
+// Documents are duplicates if they have the same distinct words, in any
+// order and with any frequencies
+void TestRemoveDuplicates() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "cat dog bird"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "bird cat dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "cat cat dog bird bird bird"s, DocumentStatus::BANNED, { 3 });
+    server.AddDocument(4, "cat dog"s, DocumentStatus::ACTUAL, { 4 });
+    server.AddDocument(5, "cat and dog with bird"s, DocumentStatus::ACTUAL, { 5 });
+    server.AddDocument(6, "dog cat"s, DocumentStatus::ACTUAL, { 6 });
+    ASSERT(server.GetDocumentFingerprint(1) == server.GetDocumentFingerprint(3));
+    ASSERT(server.GetDocumentFingerprint(1) != server.GetDocumentFingerprint(4));
+    const string output = CaptureOutput([&] { RemoveDuplicates(server); });
+    ASSERT_EQUAL(output, "Found duplicate document id 2\nFound duplicate document id 3\n"s
+        "Found duplicate document id 5\nFound duplicate document id 6\n"s);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({ 1, 4 }));
+}
+
+// In reject mode neither AddDocument nor a batch may add a duplicate of a
+// present document or of another document of the batch
+void TestRejectDuplicates() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat dog bird"s, DocumentStatus::ACTUAL, { 1 });
+    server.SetRejectDuplicates(true);
+    ASSERT_THROWS(server.AddDocument(2, "bird and dog cat cat"s, DocumentStatus::BANNED, { 2 }), invalid_argument);
+    ASSERT_EQUAL(server.GetDocumentCount(), 1);
+    server.AddDocument(2, "cat dog"s, DocumentStatus::ACTUAL, { 2 });
+
+    ASSERT_THROWS(server.AddDocuments({ { 3, "fish"s, DocumentStatus::ACTUAL, { 3 } },
+        { 4, "dog dog cat"s, DocumentStatus::ACTUAL, { 4 } } }), invalid_argument);
+    ASSERT_THROWS(server.AddDocuments({ { 3, "fish"s, DocumentStatus::ACTUAL, { 3 } },
+        { 4, "fish and fish"s, DocumentStatus::ACTUAL, { 4 } } }), invalid_argument);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT(server.FindTopDocuments("fish"s).empty());
+    server.AddDocuments({ { 3, "fish"s, DocumentStatus::ACTUAL, { 3 } }, { 4, "fish cat"s, DocumentStatus::ACTUAL, { 4 } } });
+    ASSERT_EQUAL(server.GetDocumentCount(), 4);
+
+    // A removed document no longer blocks its words
+    server.RemoveDocument(1);
+    server.AddDocument(5, "bird dog cat"s, DocumentStatus::ACTUAL, { 5 });
+    server.SetRejectDuplicates(false);
+    server.AddDocument(6, "bird dog cat"s, DocumentStatus::ACTUAL, { 6 });
+    ASSERT_EQUAL(server.GetDocumentCount(), 5);
+}
+
+// RemoveNearDuplicates must keep the documents a pairwise comparison in id
+// order keeps
+void TestRemoveNearDuplicates() {
+    mt19937 generator(20);
+    const vector<string> texts = GenerateTexts(generator, 150, 30);
+    SearchServer server(""s);
+    int id = 0;
+    for (const string& text : texts) {
+        server.AddDocument(id++, text, DocumentStatus::ACTUAL, {});
+        // Variants that differ by one word or only in word frequencies
+        server.AddDocument(id++, text + "w"s + to_string(generator() % 2000), DocumentStatus::ACTUAL, {});
+        server.AddDocument(id++, text + text.substr(0, text.find(' ')), DocumentStatus::ACTUAL, {});
+    }
+    for (const int max_distance : { 0, 7 }) {
+        SearchServer copy = server;
+        vector<int> expected_ids;
+        vector<uint64_t> kept_hashes;
+        for (const int document_id : copy) {
+            const uint64_t sim_hash = copy.ComputeSimHash(document_id);
+            if (none_of(kept_hashes.begin(), kept_hashes.end(), [&](uint64_t kept_hash) {
+                return GetHammingDistance(sim_hash, kept_hash) <= max_distance;
+                })) {
+                expected_ids.push_back(document_id);
+                kept_hashes.push_back(sim_hash);
+            }
+        }
+        CaptureOutput([&] { RemoveNearDuplicates(copy, max_distance); });
+        const vector<int> ids(copy.begin(), copy.end());
+        AssertEqual(ids, expected_ids, "max_distance "s + to_string(max_distance));
+        AssertEqual(ids.size() < texts.size() * 3, true, "nothing removed at max_distance "s + to_string(max_distance));
+    }
+    ASSERT_THROWS(RemoveNearDuplicates(server, -1), invalid_argument);
+    ASSERT_THROWS(RemoveNearDuplicates(server, 8), invalid_argument);
+    ASSERT_EQUAL(server.GetDocumentCount(), static_cast<int>(texts.size() * 3));
+}
+
+// Filters must select exactly the present documents whose status and rating
+// they accept, including ordinals past the last full 64-document block
+void TestDocumentFilter() {
+    for (size_t count = 0; count <= 130; ++count) {
+        vector<int> ratings(count);
+        for (size_t i = 0; i < count; ++i) {
+            ratings[i] = static_cast<int>(i % 13) - 6;
+        }
+        vector<uint64_t> mask((count + 63) / 64, ~uint64_t{ 0 });
+        FilterRatings(ratings.data(), count, -2, 3, mask.data());
+        for (size_t i = 0; i < count; ++i) {
+            AssertEqual((mask[i / 64] >> (i % 64) & 1) == 1, ratings[i] >= -2 && ratings[i] <= 3, "count "s + to_string(count));
+        }
+    }
+
+    constexpr int DOCUMENT_COUNT = 200;
+    SearchServer server(""s);
+    vector<DocumentStatus> statuses(DOCUMENT_COUNT);
+    vector<int> ratings(DOCUMENT_COUNT);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        statuses[id] = static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT);
+        ratings[id] = id % 17 - 8;
+        server.AddDocument(id, "cat w"s + to_string(id % 7), statuses[id], { ratings[id] });
+    }
+    for (int id = 5; id < DOCUMENT_COUNT; id += 9) {
+        server.RemoveDocument(id);
+    }
+
+    auto make_filter = [](uint32_t statuses, int min_rating, int max_rating) {
+        DocumentFilter filter;
+        filter.statuses = statuses;
+        filter.min_rating = min_rating;
+        filter.max_rating = max_rating;
+        return filter;
+    };
+    const uint32_t actual_or_banned = 1u << static_cast<int>(DocumentStatus::ACTUAL) | 1u << static_cast<int>(DocumentStatus::BANNED);
+    const vector<DocumentFilter> filters = { make_filter(DocumentFilter::ALL_STATUSES, INT_MIN, INT_MAX),
+        make_filter(DocumentFilter::ALL_STATUSES, -3, 5), make_filter(actual_or_banned, INT_MIN, INT_MAX),
+        make_filter(actual_or_banned, 0, 0), make_filter(0, INT_MIN, INT_MAX), make_filter(0, -3, 5),
+        DocumentFilter::ByStatus(DocumentStatus::REMOVED) };
+    for (size_t i = 0; i < filters.size(); ++i) {
+        const DocumentFilter& filter = filters[i];
+        vector<int> expected_ids;
+        for (const int id : server) {
+            if (filter.Accepts(statuses[id], ratings[id])) {
+                expected_ids.push_back(id);
+            }
+        }
+        const string hint = "filter "s + to_string(i);
+        AssertEqual(expected_ids.empty(), filter.statuses == 0, hint);
+        for (const bool parallel : { false, true }) {
+            const vector<Document> documents = parallel ? server.FindTopDocuments(execution::par, "cat"s, filter, DOCUMENT_COUNT)
+                : server.FindTopDocuments("cat"s, filter, DOCUMENT_COUNT);
+            vector<int> ids;
+            for (const Document& document : documents) {
+                ids.push_back(document.id);
+                AssertEqual(document.rating, ratings[document.id], hint);
+            }
+            sort(ids.begin(), ids.end());
+            AssertEqual(ids, expected_ids, hint);
+        }
+    }
+}
+
+}  // namespace
+
+void RunTests() {
+    TestRunner tr;
+    RUN_TEST(tr, TestSnapshotSavedOverLoadedFile);
+    RUN_TEST(tr, TestPrunedSearchMatchesExhaustive);
+    RUN_TEST(tr, TestTopDocumentsOrder);
+    RUN_TEST(tr, TestTopDocumentsMatchFullSort);
+    RUN_TEST(tr, TestQuotaLimitsWorkers);
+    RUN_TEST(tr, TestFlatBatchMatchesProcessQueries);
+    RUN_TEST(tr, TestCorruptedSnapshotThrows);
+    RUN_TEST(tr, TestAddDocumentsBatch);
+    RUN_TEST(tr, TestCompactKeepsResults);
+    RUN_TEST(tr, TestConcurrentReadersSeeWholeUpdates);
+    RUN_TEST(tr, TestStreamVByteRoundTrip);
+    RUN_TEST(tr, TestResultCache);
+    RUN_TEST(tr, TestParseQueryMatchesSplitting);
+    RUN_TEST(tr, TestRemoveDuplicates);
+    RUN_TEST(tr, TestRejectDuplicates);
+    RUN_TEST(tr, TestRemoveNearDuplicates);
+    RUN_TEST(tr, TestDocumentFilter);
+}
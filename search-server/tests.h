@@ -0,0 +1,4 @@
+#pragma once
+
+// Unit tests, run with `search-server test`
+void RunTests();
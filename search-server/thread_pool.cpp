@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+using namespace std;
+
+namespace {
+
+// Pool and worker index of the current thread if it is a pool worker
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+}  // namespace
+
+ThreadPool::Quota::Quota(size_t max_workers)
+    : max_workers_(max_workers) {
+}
+
+bool ThreadPool::Quota::TryAcquire() {
+    size_t used = used_workers_.load();
+    while (used < max_workers_) {
+        if (used_workers_.compare_exchange_weak(used, used + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Quota::Release() {
+    --used_workers_;
+}
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_jobs_.notify_all();
+    for (thread& worker : threads_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return threads_.size();
+}
+
+shared_ptr<ThreadPool> ThreadPool::GetDefault() {
+    static const shared_ptr<ThreadPool> pool = make_shared<ThreadPool>(max(thread::hardware_concurrency(), 1u));
+    return pool;
+}
+
+void ThreadPool::Submit(function<void()> job) {
+    {
+        // Counted before the job becomes visible, so the counter never drops
+        // below the number of queued jobs and a worker cannot sleep through it
+        lock_guard guard(mutex_);
+        ++pending_jobs_;
+        if (current_pool != this) {
+            shared_jobs_.push_back(move(job));
+        }
+    }
+    if (current_pool == this) {
+        Worker& worker = *workers_[current_worker_index];
+        lock_guard guard(worker.mutex);
+        worker.jobs.push_back(move(job));
+    }
+    has_jobs_.notify_one();
+}
+
+bool ThreadPool::TryTakeJob(size_t worker_index, function<void()>& job) {
+    // Own jobs newest first, then shared jobs, then the oldest jobs of others
+    {
+        Worker& worker = *workers_[worker_index];
+        lock_guard guard(worker.mutex);
+        if (!worker.jobs.empty()) {
+            job = move(worker.jobs.back());
+            worker.jobs.pop_back();
+            return true;
+        }
+    }
+    {
+        lock_guard guard(mutex_);
+        if (!shared_jobs_.empty()) {
+            job = move(shared_jobs_.front());
+            shared_jobs_.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(worker_index + i) % workers_.size()];
+        lock_guard guard(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+    while (true) {
+        function<void()> job;
+        if (TryTakeJob(worker_index, job)) {
+            --pending_jobs_;
+            job();
+            continue;
+        }
+        unique_lock lock(mutex_);
+        has_jobs_.wait(lock, [this] { return stopping_ || pending_jobs_ > 0; });
+        if (stopping_ && pending_jobs_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Long-lived work-stealing executor. Every worker has its own job deque:
+// jobs submitted from a worker go to its deque, idle workers steal from the
+// others, and jobs from outside threads go to a shared queue.
+class ThreadPool {
+public:
+    // Caps how many workers one client may occupy at once across all of its
+    // concurrent ParallelFor calls. The calling threads are not counted.
+    class Quota {
+    public:
+        explicit Quota(size_t max_workers);
+
+        bool TryAcquire();
+
+        void Release();
+
+    private:
+        const size_t max_workers_;
+        std::atomic<size_t> used_workers_{ 0 };
+    };
+
+    explicit ThreadPool(size_t thread_count);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    size_t GetThreadCount() const;
+
+    // Runs func(i) for every i in [0, task_count) on the workers and the
+    // calling thread and waits for all of them. The first exception thrown
+    // by a task is rethrown to the caller. Safe to call from inside a task.
+    template <typename Func>
+    void ParallelFor(size_t task_count, Func func, Quota* quota = nullptr);
+
+    // Pool sized to the hardware, shared by servers that do not set their own
+    static std::shared_ptr<ThreadPool> GetDefault();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable has_jobs_;
+    std::deque<std::function<void()>> shared_jobs_;
+    std::atomic<size_t> pending_jobs_{ 0 };
+    bool stopping_ = false;
+
+    void Submit(std::function<void()> job);
+
+    bool TryTakeJob(size_t worker_index, std::function<void()>& job);
+
+    void WorkerLoop(size_t worker_index);
+};
+
+template <typename Func>
+void ThreadPool::ParallelFor(size_t task_count, Func func, Quota* quota) {
+    // Helpers may start after the caller has already returned, so the
+    // shared state outlives this frame. A helper touches func and quota only
+    // after registering itself while tasks remain, and the caller waits for
+    // every registered helper.
+    struct State {
+        std::atomic<size_t> next_task{ 0 };
+        size_t done_tasks = 0;
+        size_t active_helpers = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    const auto state = std::make_shared<State>();
+    const auto run_tasks = [state, task_count, &func] {
+        size_t done = 0;
+        for (size_t task = state->next_task++; task < task_count; task = state->next_task++) {
+            try {
+                func(task);
+            }
+            catch (...) {
+                std::lock_guard guard(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            ++done;
+        }
+        std::lock_guard guard(state->mutex);
+        state->done_tasks += done;
+    };
+    const auto help = [state, task_count, quota, run_tasks] {
+        {
+            std::lock_guard guard(state->mutex);
+            if (state->next_task.load() >= task_count) {
+                return;
+            }
+            ++state->active_helpers;
+        }
+        if (quota == nullptr || quota->TryAcquire()) {
+            run_tasks();
+            if (quota != nullptr) {
+                quota->Release();
+            }
+        }
+        std::lock_guard guard(state->mutex);
+        --state->active_helpers;
+        state->finished.notify_all();
+    };
+    const size_t helper_count = std::min(threads_.size(), task_count > 0 ? task_count - 1 : 0);
+    for (size_t i = 0; i < helper_count; ++i) {
+        Submit(help);
+    }
+    run_tasks();
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&state, task_count] {
+        return state->done_tasks == task_count && state->active_helpers == 0; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}